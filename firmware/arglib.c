@@ -1,3 +1,5 @@
+#include <stdlib.h>
+
 #include "comlib.h"
 #include "io.h"
 
@@ -65,3 +67,30 @@ int arg_zif(void)
     }
     return 1;
 }
+
+int arg_hex(unsigned char *buf, unsigned max)
+{
+    const char *buff = strtok(NULL, " ");
+    unsigned len;
+
+    if (!buff) {
+        printf("ERROR: missing argument\r\n");
+        return -1;
+    }
+
+    len = strlen(buff);
+    if (len & 1 || len / 2 > max) {
+        printf("ERROR: expecting at most %u hex bytes\r\n", max);
+        return -1;
+    }
+    for (unsigned i = 0; i < len / 2; ++i) {
+        int hi = hex_c2i(buff[i << 1]);
+        int lo = hex_c2i(buff[(i << 1) + 1]);
+        if (hi < 0 || lo < 0) {
+            printf("ERROR: invalid hex digit\r\n");
+            return -1;
+        }
+        buf[i] = (hi << 4) | lo;
+    }
+    return len / 2;
+}
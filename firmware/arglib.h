@@ -29,6 +29,14 @@ Set last_zif on success
 */
 int arg_zif(void);
 
+/*
+Parse the next argument as hex bytes, first byte first (unlike arg_zif())
+
+Return the number of bytes parsed on success, -1 otherwise
+At most `max` bytes are accepted
+*/
+int arg_hex(unsigned char *buf, unsigned max);
+
 /*
 Convert hex nibble to int
 Return -1 on error
@@ -3,6 +3,7 @@
 #include "at89.h"
 #include "comlib.h"
 #include "io.h"
+#include "prof.h"
 #include "system.h"
 
 #define ZIFMASK_XTAL1 4;
@@ -100,7 +101,17 @@ static inline void zif_clock_write(zif_bits_t op_template, zif_bits_t op_clk,
 }
 */
 
-unsigned char at89_read(unsigned int addr)
+// P1.0-7, P2.0-3
+static const char at89_addr_pins[] = {1, 2, 3, 4, 5, 6, 7, 8, 21, 22, 23, 24};
+// P0.0-7
+static const char at89_data_pins[] = {39, 38, 37, 36, 35, 34, 33, 32};
+static zif_bus_t at89_addr_bus;
+static zif_bus_t at89_data_bus;
+static unsigned char at89_buses_init;
+// Address currently on the bus during a read sweep
+static unsigned int at89_read_addr;
+
+void at89_read_begin(unsigned int addr)
 {
     /*
      * AT89C51 Read Pinout:
@@ -122,6 +133,12 @@ unsigned char at89_read(unsigned int addr)
      * P3.7     <-      17          RE0                     // ctrl (high)
      */
 
+    if (!at89_buses_init) {
+        zif_bus_init(&at89_addr_bus, at89_addr_pins, sizeof(at89_addr_pins));
+        zif_bus_init(&at89_data_bus, at89_data_pins, sizeof(at89_data_pins));
+        at89_buses_init = 1;
+    }
+
     // Set pin direction
     zif_bits_t dir = {0,
                       0b00100000, // Busy signal (14)
@@ -138,9 +155,6 @@ unsigned char at89_read(unsigned int addr)
     vdd_val(VDD_51); // 5.0 v - 5.2 v
     vdd_en();
 
-    // Allocate an empty zifbits struct for reading pin state
-    zif_bits_t response = {0, 0, 0, 0, 0};
-
     // Base pin setting for reading
     zif_bits_t read_base = {0b00000000,
                             0b10000001, // 3.6 ctrl (16), RST (9)
@@ -148,22 +162,50 @@ unsigned char at89_read(unsigned int addr)
                             0b01100000, // VPP (31), PROG (30)
                             0b00000000};
 
-    zif_bits_t read_clk;
-
     // Mask in the address bits to the appropriate pins
     mask_addr(read_base, addr);
+    zif_write(read_base);
+    at89_read_addr = addr;
+}
 
-    // Give the clock on/off states to zif_clock_write(..) and loop 48 cycles
-    clock_write(read_base, 48);
+unsigned char at89_read_next(unsigned int addr)
+{
+    unsigned char data;
+    PROF_START(t);
+
+    // Only the address bits that differ from the last read move
+    zif_bus_step(&at89_addr_bus, at89_read_addr, addr);
+    at89_read_addr = addr;
+
+    // Loop 48 cycles
+    for (unsigned int i = 0; i <= 48; i++) {
+        at89_pin_flip_clock();
+        __delay_us(1);
+        at89_pin_flip_clock();
+        __delay_us(1);
+    }
 
     // Read the current pin state (to read in the requested byte)
-    zif_read(response);
+    data = zif_bus_r(&at89_data_bus);
+    PROF_END(PROF_AT89_READ, t);
+    return data;
+}
 
-    // We're done with the byte. Turn off all outputs.
+void at89_read_end(void)
+{
+    // We're done. Turn off all outputs.
     zif_write(at89_zbits_null);
     vdd_dis();
+}
 
-    return zif_to_data(response);
+unsigned char at89_read(unsigned int addr)
+{
+    unsigned char data;
+
+    at89_read_begin(addr);
+    data = at89_read_next(addr);
+    at89_read_end();
+    return data;
 }
 
 void at89_write(unsigned int addr, unsigned char data)
@@ -188,6 +230,8 @@ void at89_write(unsigned int addr, unsigned char data)
      * P3.7     <-      17          RE0                     // ctrl (high)
      */
 
+    PROF_START(t);
+
     printf("Writing %02X at %03X... ", data, addr);
 
     // Set pin direction
@@ -239,6 +283,7 @@ void at89_write(unsigned int addr, unsigned char data)
 
     // The client / user is expected to verify this with a read command.
     printf("done.\r\n");
+    PROF_END(PROF_AT89_WRITE, t);
 }
 
 void at89_erase()
@@ -514,8 +559,6 @@ unsigned char at89_read_sysflash(unsigned int offset)
                                  0b01100000, // VPP (31), PROG (30)
                                  0b00000000};
 
-    zif_bits_t signature_clk;
-
     // Mask in the address bits to the appropriate pins
     mask_addr(signature_base, offset);
 
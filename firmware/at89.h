@@ -4,6 +4,11 @@
 #include "io.h"
 
 unsigned char at89_read(unsigned int addr);
+// Read sweep: power up once, then read any number of addresses (sequential
+// or Gray order are cheapest), then power down
+void at89_read_begin(unsigned int addr);
+unsigned char at89_read_next(unsigned int addr);
+void at89_read_end(void);
 void at89_write(unsigned int addr, unsigned char data);
 void at89_erase();
 void at89_lock(unsigned char mode);
@@ -13,7 +18,7 @@ unsigned char at89_read_sig(unsigned int offset);
 // Flip clock pin directly from TL866
 #define at89_pin_flip_clock()                                                  \
     do {                                                                       \
-        PORTE ^= 0x4;                                                          \
+        LATE ^= 0x4;                                                           \
     } while (0)
 
 extern zif_bits_t at89_zbits_null;
@@ -1,9 +1,48 @@
+#include <xc.h>
+
 #include "comlib.h"
+#include "prof.h"
+#include "trace.h"
 
 #define MIN(X, Y) ((X) < (Y) ? (X) : (Y))
 
 int echo = 1;
+// Command lines dropped for being too long
 unsigned comblib_drops = 0;
+com_stats_t com_stats[COM_STATS_EPS];
+
+// Count an IN packet handed to the SIE
+static void stats_in(uint8_t endpoint, uint8_t len, uint8_t max)
+{
+    com_stats_t *st = &com_stats[endpoint];
+
+    st->in_packets++;
+    st->in_bytes += len;
+    if (len < max) {
+        st->in_short++;
+    }
+}
+
+static void stats_out(uint8_t endpoint, uint8_t len)
+{
+    com_stats[endpoint].out_packets++;
+    com_stats[endpoint].out_bytes += len;
+}
+
+// Halts are polled, so one set and cleared between polls is missed
+static void stats_halts(void)
+{
+    static bool halted[COM_STATS_EPS];
+
+    for (uint8_t ep = COM_ENDPOINT; ep < COM_STATS_EPS; ep++) {
+        bool now = usb_in_endpoint_halted(ep) || usb_out_endpoint_halted(ep);
+
+        if (now && !halted[ep]) {
+            com_stats[ep].halts++;
+        }
+        halted[ep] = now;
+    }
+}
 
 inline void enable_echo()
 {
@@ -15,37 +54,387 @@ inline void disable_echo()
     echo = 0;
 }
 
-// Copy to the USB buffer once it's ready.
-// str may be of any length, but it must be null-terminated
-static inline void send_string_sync(uint8_t endpoint, const char *str)
+// Output ring, filled by the mode code and drained to EP2 IN from the USB
+// interrupt as each packet completes. 256 entries so the uint8_t indexes
+// wrap for free; one entry stays empty to tell full from empty.
+static char tx_ring[COM_TX_RING];
+static volatile uint8_t tx_head = 0; /* written by mode code */
+static volatile uint8_t tx_tail = 0; /* written by the USB ISR */
+// Send short packets until the ring is empty
+static volatile bool tx_push = false;
+
+// Progress record, written by mode code and sent from the SOF interrupt.
+// 16 bit fields take two writes, so updates hold off interrupts.
+static volatile uint8_t progress_op;
+static volatile uint8_t progress_state = COM_PROGRESS_IDLE;
+static volatile uint16_t progress_addr;
+static volatile uint16_t progress_total;
+static volatile uint16_t progress_errors;
+static uint8_t progress_ms = 0;
+
+void com_progress_begin(uint8_t op, uint16_t total)
+{
+    progress_state = COM_PROGRESS_IDLE;
+    progress_op = op;
+    progress_addr = 0;
+    progress_total = total;
+    progress_errors = 0;
+    progress_ms = 0;
+    progress_state = COM_PROGRESS_RUNNING;
+}
+
+void com_progress(uint16_t addr, uint16_t errors)
+{
+    unsigned char gie = INTCONbits.GIE;
+
+    INTCONbits.GIE = 0;
+    progress_addr = addr;
+    progress_errors = errors;
+    INTCONbits.GIE = gie;
+}
+
+void com_progress_end(void)
+{
+    if (progress_state == COM_PROGRESS_RUNNING) {
+        progress_state = COM_PROGRESS_DONE;
+    }
+}
+
+void com_sof(void)
+{
+    uint8_t *buf;
+
+    if (progress_state == COM_PROGRESS_IDLE) {
+        return;
+    }
+    // The final record goes out as soon as the endpoint is free
+    if (progress_ms < COM_PROGRESS_MS) {
+        progress_ms++;
+    }
+    if ((progress_state == COM_PROGRESS_RUNNING &&
+         progress_ms < COM_PROGRESS_MS) ||
+        usb_in_endpoint_busy(COM_NOTIFY_ENDPOINT)) {
+        return;
+    }
+    progress_ms = 0;
+
+    buf = usb_get_in_buffer(COM_NOTIFY_ENDPOINT);
+    buf[0] = 0xA1;
+    buf[1] = COM_NOTIFY_PROGRESS;
+    buf[2] = 0;
+    buf[3] = 0;
+    buf[4] = 0;
+    buf[5] = 0;
+    buf[6] = 8;
+    buf[7] = 0;
+    buf[8] = progress_op;
+    buf[9] = progress_state;
+    buf[10] = progress_addr & 0xFF;
+    buf[11] = progress_addr >> 8;
+    buf[12] = progress_total & 0xFF;
+    buf[13] = progress_total >> 8;
+    buf[14] = progress_errors & 0xFF;
+    buf[15] = progress_errors >> 8;
+    usb_send_in_buffer(COM_NOTIFY_ENDPOINT, 16);
+    stats_in(COM_NOTIFY_ENDPOINT, 16, EP_1_IN_LEN);
+
+    if (progress_state == COM_PROGRESS_DONE) {
+        progress_state = COM_PROGRESS_IDLE;
+    }
+}
+
+// com_stream() owns the endpoint
+static volatile bool tx_stream = false;
+
+// Send packets while an endpoint buffer is free (two with ping-pong) and
+// there is a full packet or a pending flush. Runs in the USB ISR and with
+// interrupts masked.
+static void tx_send(void)
 {
-    unsigned int len = strlen(str);
-    unsigned num_bytes_to_send;
-    char *in_buf = NULL;
+    while (!tx_stream) {
+        uint8_t avail = tx_head - tx_tail;
+        uint8_t tail = tx_tail;
+        uint8_t n;
+        char *in_buf;
 
-    while (len > 0) {
-        while (usb_in_endpoint_busy(endpoint))
-            ;
-        in_buf = (char *)usb_get_in_buffer(endpoint);
-        num_bytes_to_send = MIN(len, 64);
-        memcpy(in_buf, str, num_bytes_to_send);
-        usb_send_in_buffer(endpoint, num_bytes_to_send);
-        len -= num_bytes_to_send;
-        str += num_bytes_to_send;
+        if (!avail) {
+            tx_push = false;
+            return;
+        }
+        if ((avail < COM_TX_SIZE && !tx_push) ||
+            usb_in_endpoint_busy(COM_ENDPOINT)) {
+            return;
+        }
+        n = avail < COM_TX_SIZE ? avail : COM_TX_SIZE;
+        in_buf = (char *)usb_get_in_buffer(COM_ENDPOINT);
+        for (uint8_t i = 0; i < n; i++) {
+            in_buf[i] = tx_ring[tail++];
+        }
+        usb_send_in_buffer(COM_ENDPOINT, n);
+        stats_in(COM_ENDPOINT, n, EP_2_IN_LEN);
+        TRACE_EV(TRACE_EP2_IN, n);
+        tx_tail = tail;
     }
 }
 
-static inline void send_char_sync(uint8_t endpoint, char c)
+// Start a packet from mode code. Once one is in flight, com_in_complete()
+// keeps the endpoint busy by itself.
+static void tx_kick(void)
 {
-    char *in_buf = NULL;
+    unsigned char gie = INTCONbits.GIE;
+
+    INTCONbits.GIE = 0;
+    tx_send();
+    INTCONbits.GIE = gie;
+}
 
-    while (usb_in_endpoint_busy(endpoint))
+void com_in_complete(uint8_t endpoint)
+{
+    if (endpoint == COM_ENDPOINT) {
+        tx_send();
+    }
+}
+
+void com_flush(void)
+{
+    if (tx_head == tx_tail) {
+        return;
+    }
+    tx_push = true;
+    tx_kick();
+}
+
+void com_stream(uint16_t len, com_producer_t producer, void *ctx)
+{
+    // Earlier output goes first, then the ISR stays off the endpoint
+    com_flush();
+    while (tx_head != tx_tail)
         ;
+    tx_stream = true;
 
-    in_buf = (char *)usb_get_in_buffer(endpoint);
-    in_buf[0] = c;
+    while (len) {
+        uint8_t n = len < COM_TX_SIZE ? len : COM_TX_SIZE;
 
-    usb_send_in_buffer(endpoint, 1);
+        // With ping-pong this only waits when both buffers are on the bus
+        if (usb_in_endpoint_busy(COM_ENDPOINT)) {
+            PROF_START(t);
+
+            while (usb_in_endpoint_busy(COM_ENDPOINT)) {
+                com_stats[COM_ENDPOINT].busy_spins++;
+            }
+            PROF_END(PROF_USB_TX, t);
+        }
+        producer(ctx, usb_get_in_buffer(COM_ENDPOINT), n);
+        usb_send_in_buffer(COM_ENDPOINT, n);
+        stats_in(COM_ENDPOINT, n, EP_2_IN_LEN);
+        TRACE_EV(TRACE_EP2_IN, n);
+        len -= n;
+    }
+
+    tx_stream = false;
+}
+
+struct hex_stream {
+    com_byte_source_t src;
+    void *ctx;
+    uint16_t idx;
+    uint8_t byte;
+    uint8_t phase; /* next character of " XX", or of "XX " if trail */
+    uint8_t trail;
+};
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+static void hex_producer(void *ctx, uint8_t *buf, uint8_t len)
+{
+    struct hex_stream *hs = ctx;
+
+    while (len--) {
+        if (!hs->phase) {
+            hs->byte = hs->src(hs->ctx, hs->idx++);
+        }
+        switch (hs->phase + hs->trail) {
+        case 1:
+            *buf++ = hex_digits[hs->byte >> 4];
+            break;
+        case 2:
+            *buf++ = hex_digits[hs->byte & 0xF];
+            break;
+        default:
+            *buf++ = ' ';
+            break;
+        }
+        hs->phase = hs->phase == 2 ? 0 : hs->phase + 1;
+    }
+}
+
+static void stream_hex(uint16_t count, com_byte_source_t src, void *ctx,
+                       uint8_t trail)
+{
+    struct hex_stream hs = {src, ctx, 0, 0, 0, trail};
+
+    // Stream lengths are 16 bit, 3 characters per byte
+    while (count) {
+        uint16_t n = count < COM_STREAM_HEX_MAX ? count : COM_STREAM_HEX_MAX;
+
+        com_stream(3 * n, hex_producer, &hs);
+        count -= n;
+    }
+}
+
+void com_stream_hex(uint16_t count, com_byte_source_t src, void *ctx)
+{
+    stream_hex(count, src, ctx, 0);
+}
+
+void com_stream_hex_trailing(uint16_t count, com_byte_source_t src, void *ctx)
+{
+    stream_hex(count, src, ctx, 1);
+}
+
+// Intel HEX record being sent, one line at a time
+struct ihex_stream {
+    com_byte_source_t src;
+    void *ctx;
+    uint16_t idx;
+    uint16_t count;
+    uint16_t addr;
+    uint8_t pos;
+    uint8_t len;
+    char line[COM_IHEX_LINE_MAX];
+};
+
+static uint8_t ihex_put8(char *out, uint8_t b)
+{
+    out[0] = hex_digits[b >> 4];
+    out[1] = hex_digits[b & 0xF];
+    return b;
+}
+
+// Format the next data record (or the EOF record once all bytes are done)
+static void ihex_next(struct ihex_stream *is)
+{
+    uint8_t n = is->count - is->idx < COM_IHEX_RECORD
+                    ? is->count - is->idx
+                    : COM_IHEX_RECORD;
+    uint16_t addr = is->addr + is->idx;
+    uint8_t sum;
+    char *out = is->line;
+
+    if (!n) {
+        memcpy(is->line, ":00000001FF\r\n", 13);
+        is->len = 13;
+        is->pos = 0;
+        return;
+    }
+
+    *out++ = ':';
+    sum = ihex_put8(out, n);
+    sum += ihex_put8(out + 2, addr >> 8);
+    sum += ihex_put8(out + 4, addr & 0xFF);
+    ihex_put8(out + 6, 0x00);
+    out += 8;
+    for (uint8_t i = 0; i < n; i++) {
+        sum += ihex_put8(out, is->src(is->ctx, is->idx++));
+        out += 2;
+    }
+    ihex_put8(out, -sum);
+    out[2] = '\r';
+    out[3] = '\n';
+    is->len = out + 4 - is->line;
+    is->pos = 0;
+}
+
+static void ihex_producer(void *ctx, uint8_t *buf, uint8_t len)
+{
+    struct ihex_stream *is = ctx;
+
+    while (len--) {
+        if (is->pos == is->len) {
+            ihex_next(is);
+        }
+        *buf++ = is->line[is->pos++];
+    }
+}
+
+void com_stream_ihex(uint16_t addr, uint16_t count, com_byte_source_t src,
+                     void *ctx)
+{
+    struct ihex_stream is;
+    uint16_t records = count / COM_IHEX_RECORD;
+    uint16_t tail = count % COM_IHEX_RECORD;
+    // 13 characters of framing per record, EOF record included
+    uint32_t total = 13UL * (records + (tail ? 1 : 0) + 1) + 2UL * count;
+
+    is.src = src;
+    is.ctx = ctx;
+    is.idx = 0;
+    is.count = count;
+    is.addr = addr;
+    is.pos = 0;
+    is.len = 0;
+    // Stream lengths are 16 bit
+    while (total) {
+        uint16_t n = total < 0xF000 ? total : 0xF000;
+
+        com_stream(n, ihex_producer, &is);
+        total -= n;
+    }
+}
+
+static void tx_put(char c)
+{
+    uint8_t head = tx_head;
+
+    // Only blocks when the host has fallen a whole ring behind
+    if ((uint8_t)(head + 1) == tx_tail) {
+        PROF_START(t);
+
+        while ((uint8_t)(head + 1) == tx_tail) {
+            com_stats[COM_ENDPOINT].busy_spins++;
+            tx_kick();
+        }
+        PROF_END(PROF_USB_TX, t);
+    }
+    tx_ring[head] = c;
+    tx_head = head + 1;
+    if ((uint8_t)(tx_head - tx_tail) == COM_TX_SIZE) {
+        // Endpoint may have gone idle waiting for a full packet
+        tx_kick();
+    }
+}
+
+// Binary command being handled, see com_frame_ops()
+static bool frame_busy = false;
+
+// Interactive (echo on) sessions see each line as soon as it is complete
+static inline void com_putc(char c)
+{
+    // Text from code behind a binary command would corrupt its reply
+    if (frame_busy) {
+        return;
+    }
+    tx_put(c);
+    if (c == '\n' && echo) {
+        com_flush();
+    }
+}
+
+void com_print_hex(uint16_t val, uint8_t digits)
+{
+    while (digits--) {
+        com_putc(hex_digits[(val >> (4 * digits)) & 0xF]);
+    }
+}
+
+// Queue str for the host, sending packets as the buffer fills.
+// str may be of any length, but it must be null-terminated
+static inline void send_string_sync(uint8_t endpoint, const char *str)
+{
+    (void)endpoint;
+    while (*str) {
+        com_putc(*str++);
+    }
 }
 
 static inline bool usb_ready()
@@ -54,72 +443,612 @@ static inline bool usb_ready()
            usb_out_endpoint_has_data(COM_ENDPOINT);
 }
 
-// Read a line from USB input. Blocking.
-unsigned char *com_readline()
+// Input ring, filled a whole EP2 OUT packet at a time. The endpoint is
+// only re-armed once a packet fits, so a host that runs ahead is NAKed
+// rather than dropped. Same uint8_t index wrap as the output ring.
+static unsigned char rx_ring[COM_RX_RING];
+static uint8_t rx_head = 0;
+static uint8_t rx_tail = 0;
+
+static void rx_fill(void)
 {
-    // TODO: Might be good to make a global struct to handle the command buffer
-    static unsigned char cmd_buf[64];
-    memset(cmd_buf, 0, sizeof(cmd_buf));
-    int cmd_ptr = 0;
+    const unsigned char *out_buf;
+    uint8_t out_buf_len;
+    uint8_t head = rx_head;
 
-    while (1) {
-        /* Handle data received from the host */
-        if (usb_ready()) {
+    // Free space, one entry always stays empty
+    while ((uint8_t)(rx_tail - head - 1) >= EP_2_OUT_LEN && usb_ready()) {
+        out_buf_len = usb_get_out_buffer(COM_ENDPOINT, &out_buf);
+        stats_out(COM_ENDPOINT, out_buf_len);
+        for (uint8_t i = 0; i < out_buf_len; i++) {
+            rx_ring[head++] = out_buf[i];
+        }
+        usb_arm_out_endpoint(COM_ENDPOINT);
+    }
+    rx_head = head;
+}
 
-            const unsigned char *out_buf;
+/*
+Binary frames
 
-            uint8_t out_buf_len;
-            int newline_found = 0;
+Request: ESC, len (u16), op, seq, payload[len], crc (u16)
+Reply:   ESC, len (u16), op, seq, status, data[len - 1], crc (u16)
+Multi byte fields are little endian. The CRC is CRC-16/CCITT-FALSE over
+everything after ESC, as sent.
 
-            /* Check for an empty transaction. */
-            out_buf_len = usb_get_out_buffer(COM_ENDPOINT, &out_buf);
-            if (out_buf_len <= 0) {
-                goto empty;
-            }
+With COM_FRAME_F_RLE negotiated, payload and reply bytes (status included)
+are run length coded: two equal bytes in a row are followed by a count of
+further repeats (0-255). len stays the decoded length, so either side knows
+where the coded bytes end. Worst case is 3 bytes for 2, 257 0xFF cost 3.
 
-            /* If copying would overflow, discard whole command and error. */
-            if (cmd_ptr + out_buf_len > 63) {
-                com_print("Error: Command buffer exceeded.\r\n");
-                cmd_ptr = 0;
-                goto empty;
-            }
+On the bulk interface a reply always ends with a short (possibly zero
+length) packet.
+*/
 
-            /* Look for a full line. */
-            memcpy(cmd_buf + cmd_ptr, out_buf, out_buf_len);
-            for (int i = 0; i < out_buf_len; i++) {
-                if (cmd_buf[cmd_ptr + i] == '\n' ||
-                    cmd_buf[cmd_ptr + i] == '\r') {
-                    cmd_buf[cmd_ptr + i] = 0;
-                    newline_found = 1;
-                    cmd_ptr = 0;
-                    break;
-                }
-            }
+enum {
+    FRAME_IDLE = 0,
+    FRAME_LEN0,
+    FRAME_LEN1,
+    FRAME_OP,
+    FRAME_SEQ,
+    FRAME_DATA,
+    FRAME_CRC0,
+    FRAME_CRC1,
+};
 
-            if (echo) {
-                printf(out_buf);
+// Frames arrive on the console (EP2) or the bulk interface (EP3), each has
+// its own receiver and replies go back where the request came from
+struct frame_rx {
+    uint8_t state;
+    uint8_t endpoint;
+    uint16_t len;
+    uint16_t got;
+    uint8_t op;
+    uint8_t seq;
+    uint16_t crc;
+    uint8_t crc_lo;
+    // RLE decoder
+    bool rle;
+    bool rle_pair;
+    bool rle_count;
+    uint8_t rle_prev;
+    uint8_t buf[COM_FRAME_MAX];
+};
+
+static struct frame_rx com_frame = {.state = FRAME_IDLE,
+                                    .endpoint = COM_ENDPOINT};
+static struct frame_rx bulk_frame = {.state = FRAME_IDLE,
+                                     .endpoint = COM_BULK_ENDPOINT};
+
+static const com_frame_op_t *frame_ops = NULL;
+static uint8_t frame_nops = 0;
+// Negotiated COM_FRAME_F_* options
+static uint8_t frame_flags = 0;
+
+// Frame being answered
+static uint8_t frame_ep;
+static uint8_t frame_op;
+static uint8_t frame_seq;
+static bool frame_replied;
+static uint16_t frame_reply_left;
+static uint16_t frame_reply_crc;
+// RLE encoder: a pair went out and its repeat count is rle_run
+static bool frame_rle;
+static bool rle_pair;
+static bool rle_prev_ok;
+static uint8_t rle_prev;
+static uint8_t rle_run;
+
+// Bulk IN packet being filled, in the USB buffer itself
+static uint8_t *bulk_buf = NULL;
+static uint8_t bulk_len = 0;
+static bool bulk_full = false;
 
-                // Temporary workaround buffer printing out previous char of
-                // previous input characters after a certain length.
-                // Real fix is to make sure all strings are properly null
-                // terminated. TODO
-                memset(out_buf, 0, 64);
+static void bulk_send(void)
+{
+    usb_send_in_buffer(COM_BULK_ENDPOINT, bulk_len);
+    stats_in(COM_BULK_ENDPOINT, bulk_len, EP_3_IN_LEN);
+    TRACE_EV(TRACE_EP3_IN, bulk_len);
+    bulk_full = bulk_len == EP_3_IN_LEN;
+    bulk_buf = NULL;
+    bulk_len = 0;
+}
+
+static void bulk_put(uint8_t b)
+{
+    if (!bulk_buf) {
+        // With ping-pong this only waits when both buffers are on the bus
+        if (usb_in_endpoint_busy(COM_BULK_ENDPOINT)) {
+            PROF_START(t);
+
+            while (usb_in_endpoint_busy(COM_BULK_ENDPOINT)) {
+                com_stats[COM_BULK_ENDPOINT].busy_spins++;
             }
+            PROF_END(PROF_USB_TX, t);
+        }
+        bulk_buf = usb_get_in_buffer(COM_BULK_ENDPOINT);
+    }
+    bulk_buf[bulk_len++] = b;
+    if (bulk_len == EP_3_IN_LEN) {
+        bulk_send();
+    }
+}
 
-            if (!newline_found) {
-                cmd_ptr += out_buf_len;
-                goto empty;
+// End of a reply: short (or zero length) packet so the host read completes
+static void bulk_flush(void)
+{
+    if (bulk_len || bulk_full) {
+        if (!bulk_buf) {
+            while (usb_in_endpoint_busy(COM_BULK_ENDPOINT)) {
+                com_stats[COM_BULK_ENDPOINT].busy_spins++;
             }
+        }
+        bulk_send();
+    }
+}
 
-            cmd_ptr = 0;
+static void frame_out(uint8_t b)
+{
+    if (frame_ep == COM_BULK_ENDPOINT) {
+        bulk_put(b);
+    } else {
+        tx_put(b);
+    }
+}
 
-            usb_arm_out_endpoint(COM_ENDPOINT);
+static uint16_t crc16_update(uint16_t crc, uint8_t b)
+{
+    uint8_t x = (crc >> 8) ^ b;
 
-            return cmd_buf;
+    x ^= x >> 4;
+    return (crc << 8) ^ ((uint16_t)x << 12) ^ ((uint16_t)x << 5) ^ x;
+}
+
+static void frame_tx(uint8_t b)
+{
+    frame_reply_crc = crc16_update(frame_reply_crc, b);
+    frame_out(b);
+}
+
+void com_frame_ops(const com_frame_op_t *ops, uint8_t nops)
+{
+    frame_ops = ops;
+    frame_nops = nops;
+}
+
+static void rle_put(uint8_t b)
+{
+    if (rle_pair) {
+        if (b == rle_prev && rle_run < 0xFF) {
+            rle_run++;
+            return;
+        }
+        frame_tx(rle_run);
+        rle_pair = false;
+        rle_prev_ok = false;
+    }
+    frame_tx(b);
+    if (rle_prev_ok && b == rle_prev) {
+        rle_pair = true;
+        rle_run = 0;
+    }
+    rle_prev = b;
+    rle_prev_ok = true;
+}
+
+void com_frame_reply(uint8_t status, uint16_t len)
+{
+    frame_replied = true;
+    frame_rle = (frame_flags & COM_FRAME_F_RLE) &&
+                frame_op != COM_FRAME_OP_OPTS;
+    rle_pair = false;
+    rle_prev_ok = false;
+    frame_out(COM_FRAME_ESC);
+    frame_reply_crc = 0xFFFF;
+    frame_tx((len + 1) & 0xFF);
+    frame_tx((len + 1) >> 8);
+    frame_tx(frame_op);
+    frame_tx(frame_seq);
+    frame_reply_left = len + 1;
+    com_frame_put(status);
+}
+
+void com_frame_put(uint8_t b)
+{
+    if (!frame_reply_left) {
+        return;
+    }
+    if (frame_rle) {
+        rle_put(b);
+    } else {
+        frame_tx(b);
+    }
+    if (!--frame_reply_left) {
+        if (rle_pair) {
+            frame_tx(rle_run);
+        }
+        frame_out(frame_reply_crc & 0xFF);
+        frame_out(frame_reply_crc >> 8);
+        if (frame_ep == COM_BULK_ENDPOINT) {
+            bulk_flush();
+        } else {
+            com_flush();
+        }
+    }
+}
+
+void com_frame_write(const uint8_t *buf, uint16_t len)
+{
+    while (len--) {
+        com_frame_put(*buf++);
+    }
+}
+
+/*
+Write streams
+
+Data frames land in wr_ring and are handed to the sink from com_readline().
+wr_in / wr_out count stream bytes and wrap together, so their difference is
+the ring fill even across the 64k boundary.
+*/
+static uint8_t wr_ring[COM_WR_WINDOW];
+static uint16_t wr_in;
+static uint16_t wr_out;
+static uint16_t wr_len;
+static uint16_t wr_acked;
+static com_wr_sink_t wr_sink = NULL;
+static void *wr_ctx;
+static uint8_t wr_ep;
+
+uint16_t com_wr_begin(uint16_t len, com_wr_sink_t sink, void *ctx)
+{
+    wr_in = 0;
+    wr_out = 0;
+    wr_acked = 0;
+    wr_len = len;
+    wr_ctx = ctx;
+    wr_ep = frame_ep;
+    wr_sink = len ? sink : NULL;
+    return COM_WR_WINDOW;
+}
+
+// Credit frame: consumed byte count, or the status the stream ended with
+static void wr_credit(uint8_t status)
+{
+    frame_ep = wr_ep;
+    frame_op = COM_FRAME_OP_CREDIT;
+    frame_seq = 0;
+    com_frame_reply(status, 2);
+    com_frame_put(wr_out & 0xFF);
+    com_frame_put(wr_out >> 8);
+    wr_acked = wr_out;
+    if (status != COM_FRAME_OK) {
+        // The sink never sees the end, finish its progress record
+        com_progress_end();
+        wr_sink = NULL;
+    } else if (wr_out == wr_len) {
+        wr_sink = NULL;
+    }
+}
+
+// Payload of a data frame. Not answered, credit frames are the reply
+static void wr_data(const uint8_t *buf, uint16_t len)
+{
+    if (!wr_sink) {
+        com_frame_reply(COM_FRAME_E_CMD, 0);
+        return;
+    }
+    // The host sent more than it had credit for
+    if (len > COM_WR_WINDOW - (uint16_t)(wr_in - wr_out) ||
+        len > (uint16_t)(wr_len - wr_in)) {
+        wr_credit(COM_FRAME_E_LEN);
+        return;
+    }
+    while (len--) {
+        wr_ring[wr_in++ % COM_WR_WINDOW] = *buf++;
+    }
+}
+
+// Hand buffered stream data to the sink, a contiguous run at a time
+static void wr_pump(void)
+{
+    uint16_t pos;
+    uint16_t run;
+    bool ok;
+
+    while (wr_sink && wr_in != wr_out) {
+        pos = wr_out % COM_WR_WINDOW;
+        run = MIN((uint16_t)(wr_in - wr_out), COM_WR_WINDOW - pos);
+        frame_busy = true;
+        ok = wr_sink(wr_ctx, wr_out, &wr_ring[pos], run);
+        frame_busy = false;
+        wr_out += run;
+        // Return credit in useful amounts, not per sink call
+        if (!ok) {
+            wr_credit(COM_FRAME_E_CMD);
+        } else if (wr_out == wr_len || wr_in == wr_out ||
+                   (uint16_t)(wr_out - wr_acked) >= COM_WR_WINDOW / 2) {
+            wr_credit(COM_FRAME_OK);
+        }
+    }
+}
+
+static bool sink_discard(void *ctx, uint16_t off, const uint8_t *buf,
+                         uint16_t len)
+{
+    (void)ctx;
+    (void)off;
+    (void)buf;
+    (void)len;
+    return true;
+}
+
+// Built in ops, true if fr was one
+static bool frame_self_test(const struct frame_rx *fr)
+{
+    switch (fr->op) {
+    case COM_FRAME_OP_PING:
+        com_frame_reply(COM_FRAME_OK, fr->len);
+        com_frame_write(fr->buf, fr->len);
+        return true;
+
+    case COM_FRAME_OP_SOURCE: {
+        uint16_t len;
+        uint8_t b;
 
-        // Jump here when encountering empty string
-        empty:
-            usb_arm_out_endpoint(COM_ENDPOINT);
+        if (fr->len != 3 || COM_U16(fr->buf) > COM_TEST_MAX) {
+            com_frame_reply(COM_FRAME_E_ARG, 0);
+            return true;
+        }
+        len = COM_U16(fr->buf);
+        b = fr->buf[2];
+        com_frame_reply(COM_FRAME_OK, len);
+        while (len--) {
+            com_frame_put(b++);
+        }
+        return true;
+    }
+
+    case COM_FRAME_OP_SINK: {
+        uint16_t window;
+
+        if (fr->len != 2) {
+            com_frame_reply(COM_FRAME_E_ARG, 0);
+            return true;
+        }
+        window = com_wr_begin(COM_U16(fr->buf), sink_discard, NULL);
+        com_frame_reply(COM_FRAME_OK, 2);
+        com_frame_put(window & 0xFF);
+        com_frame_put(window >> 8);
+        return true;
+    }
+    }
+    return false;
+}
+
+static void frame_dispatch(const struct frame_rx *fr)
+{
+    uint8_t i;
+
+    frame_replied = false;
+    frame_busy = true;
+    if (fr->op == COM_FRAME_OP_OPTS) {
+        // Takes effect after this reply, which is never coded
+        if (fr->len != 1) {
+            com_frame_reply(COM_FRAME_E_ARG, 0);
+        } else {
+            com_frame_reply(COM_FRAME_OK, 1);
+            com_frame_put(fr->buf[0] & COM_FRAME_F_ALL);
+            frame_flags = fr->buf[0] & COM_FRAME_F_ALL;
+        }
+        frame_busy = false;
+        return;
+    }
+    if (fr->op == COM_FRAME_OP_DATA) {
+        wr_data(fr->buf, fr->len);
+        frame_busy = false;
+        return;
+    }
+    PROF_CMD_BEGIN(fr->op | 0x80);
+    TRACE_EV(TRACE_FRAME, fr->op);
+    for (i = 0; i < frame_nops; i++) {
+        if (frame_ops[i].op == fr->op) {
+            frame_ops[i].fn(fr->buf, fr->len);
+            break;
+        }
+    }
+    if (i == frame_nops) {
+        if (!frame_self_test(fr)) {
+            com_frame_reply(COM_FRAME_E_OP, 0);
+        }
+    } else if (!frame_replied) {
+        com_frame_reply(COM_FRAME_OK, 0);
+    }
+    // Finish a short reply so the host stays in sync
+    while (frame_reply_left) {
+        com_frame_put(0);
+    }
+    TRACE_EV(TRACE_FRAME_END, fr->op);
+    PROF_CMD_END();
+    frame_busy = false;
+}
+
+// Store a decoded payload byte
+static void frame_rx_put(struct frame_rx *fr, uint8_t c)
+{
+    // len <= COM_FRAME_MAX, see FRAME_LEN1
+    fr->buf[fr->got++] = c;
+}
+
+static void frame_rx_data(struct frame_rx *fr, uint8_t c)
+{
+    if (!fr->rle) {
+        frame_rx_put(fr, c);
+    } else if (fr->rle_count) {
+        // Repeats past len are a host bug, the CRC still covers them
+        while (c-- && fr->got < fr->len) {
+            frame_rx_put(fr, fr->rle_prev);
+        }
+        fr->rle_count = false;
+        fr->rle_pair = false;
+    } else {
+        frame_rx_put(fr, c);
+        fr->rle_count = fr->rle_pair && c == fr->rle_prev;
+        fr->rle_pair = !fr->rle_count;
+        fr->rle_prev = c;
+    }
+    if (fr->got == fr->len && !fr->rle_count) {
+        fr->state = FRAME_CRC0;
+    }
+}
+
+// Feed one input byte to a receiver. Returns false if c is not part of a
+// frame.
+static bool frame_rx(struct frame_rx *fr, unsigned char c)
+{
+    if (fr->state == FRAME_IDLE) {
+        if (c != COM_FRAME_ESC) {
+            return false;
+        }
+        fr->crc = 0xFFFF;
+        fr->state = FRAME_LEN0;
+        return true;
+    }
+    if (fr->state != FRAME_CRC0 && fr->state != FRAME_CRC1) {
+        fr->crc = crc16_update(fr->crc, c);
+    }
+    switch (fr->state) {
+    case FRAME_LEN0:
+        fr->len = c;
+        fr->state = FRAME_LEN1;
+        break;
+    case FRAME_LEN1:
+        fr->len |= (uint16_t)c << 8;
+        fr->state = FRAME_OP;
+        if (fr->len > COM_FRAME_MAX) {
+            // Don't sit on up to 64K of input for a bad length: reject it
+            // now (op and seq are not known yet) and resync on the next ESC
+            fr->state = FRAME_IDLE;
+            frame_ep = fr->endpoint;
+            frame_op = 0;
+            frame_seq = 0;
+            com_frame_reply(COM_FRAME_E_LEN, 0);
+        }
+        break;
+    case FRAME_OP:
+        fr->op = c;
+        fr->state = FRAME_SEQ;
+        break;
+    case FRAME_SEQ:
+        fr->seq = c;
+        fr->got = 0;
+        fr->rle = (frame_flags & COM_FRAME_F_RLE) &&
+                  fr->op != COM_FRAME_OP_OPTS;
+        fr->rle_pair = false;
+        fr->rle_count = false;
+        fr->state = fr->len ? FRAME_DATA : FRAME_CRC0;
+        break;
+    case FRAME_DATA:
+        frame_rx_data(fr, c);
+        break;
+    case FRAME_CRC0:
+        fr->crc_lo = c;
+        fr->state = FRAME_CRC1;
+        break;
+    default:
+        fr->state = FRAME_IDLE;
+        frame_ep = fr->endpoint;
+        frame_op = fr->op;
+        frame_seq = fr->seq;
+        if ((fr->crc_lo | ((uint16_t)c << 8)) != fr->crc) {
+            com_frame_reply(COM_FRAME_E_CRC, 0);
+        } else {
+            frame_dispatch(fr);
+        }
+        break;
+    }
+    return true;
+}
+
+// Handle frames from the bulk interface, anything else there is ignored
+static void bulk_poll(void)
+{
+    const unsigned char *out_buf;
+    uint8_t out_buf_len;
+
+    if (!usb_is_configured() || usb_out_endpoint_halted(COM_BULK_ENDPOINT) ||
+        !usb_out_endpoint_has_data(COM_BULK_ENDPOINT)) {
+        return;
+    }
+    out_buf_len = usb_get_out_buffer(COM_BULK_ENDPOINT, &out_buf);
+    stats_out(COM_BULK_ENDPOINT, out_buf_len);
+    for (uint8_t i = 0; i < out_buf_len; i++) {
+        frame_rx(&bulk_frame, out_buf[i]);
+    }
+    usb_arm_out_endpoint(COM_BULK_ENDPOINT);
+}
+
+// Read a line from USB input. Blocking.
+// Lines are split out of the input ring, so a host may queue any number of
+// commands, several per packet or one split across packets. Binary frames
+// met on the way, and any on the bulk interface, are handled here.
+unsigned char *com_readline()
+{
+    static unsigned char cmd_buf[COM_LINE_MAX + 1];
+    static unsigned char last_c = 0;
+    uint8_t cmd_ptr = 0;
+    bool overflow = false;
+
+    // Anything printed so far (ex: the prompt) is waiting on this input
+    com_flush();
+
+    while (1) {
+        stats_halts();
+        bulk_poll();
+        rx_fill();
+        wr_pump();
+        while (rx_tail != rx_head) {
+            unsigned char c = rx_ring[rx_tail++];
+            bool crlf = last_c == '\r' && c == '\n';
+
+            // Binary frames may only start where a line would
+            if ((com_frame.state != FRAME_IDLE || !cmd_ptr) &&
+                frame_rx(&com_frame, c)) {
+                last_c = 0;
+                continue;
+            }
+
+            last_c = c;
+            // A "\r\n" terminated line is one command, not two
+            if (crlf) {
+                continue;
+            }
+            if (echo) {
+                com_putc(c);
+            }
+            if (c != '\n' && c != '\r') {
+                if (cmd_ptr < COM_LINE_MAX) {
+                    cmd_buf[cmd_ptr++] = c;
+                } else {
+                    overflow = true;
+                }
+                continue;
+            }
+
+            // Discard the whole command and error
+            if (overflow) {
+                comblib_drops++;
+                com_print("Error: Command buffer exceeded.\r\n");
+                com_flush();
+                cmd_ptr = 0;
+                overflow = false;
+                continue;
+            }
+            cmd_buf[cmd_ptr] = 0;
+            if (echo) {
+                com_flush();
+            }
+            return cmd_buf;
         }
     }
     return NULL;
@@ -139,17 +1068,38 @@ void com_println(const char *str)
 // used by printf type functions
 void putch(const unsigned char c)
 {
-    // TODO: Make a buffer and flush function to avoid sending one character
-    // per USB packet.
-    send_char_sync(COM_ENDPOINT, c);
+    com_putc(c);
 }
 
 char *com_cmd_prompt(void)
 {
     char *cmd;
 
+    // The previous command is over once it asks for the next one
+    PROF_CMD_END();
+    TRACE_EV(TRACE_CMD_END, 0);
     printf("CMD> ");
-    cmd = com_readline();
+    cmd = (char *)com_readline();
+    PROF_CMD_BEGIN(cmd[0]);
+    TRACE_EV(TRACE_CMD, cmd[0]);
     com_println("");
     return cmd;
 }
+
+void com_stats_print(void)
+{
+    printf("ep  in_pkts in_short   in_bytes out_pkts  out_bytes      spins "
+           "halts\r\n");
+    for (uint8_t ep = COM_NOTIFY_ENDPOINT; ep < COM_STATS_EPS; ep++) {
+        const com_stats_t *st = &com_stats[ep];
+
+        printf("%2u %8u %8u %10lu %8u %10lu %10lu %5u\r\n", ep,
+               st->in_packets, st->in_short, (unsigned long)st->in_bytes,
+               st->out_packets, (unsigned long)st->out_bytes,
+               (unsigned long)st->busy_spins, st->halts);
+    }
+    printf("cmd overflows %u\r\n", comblib_drops);
+
+    memset(com_stats, 0, sizeof(com_stats));
+    comblib_drops = 0;
+}
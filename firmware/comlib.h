@@ -6,9 +6,16 @@
 #include <string.h>
 
 #define COM_ENDPOINT 2
-
-static inline void send_string_sync(uint8_t endpoint, const char *str);
-static inline bool usb_ready();
+// Vendor class bulk interface, binary frames only
+#define COM_BULK_ENDPOINT 3
+// EP2 IN packet size
+#define COM_TX_SIZE 64
+// Longest command line
+#define COM_LINE_MAX 63
+// Input ring size, must stay 256 (indexes are uint8_t)
+#define COM_RX_RING 256
+// Output ring size, must stay 256 (indexes are uint8_t)
+#define COM_TX_RING 256
 
 inline void enable_echo();
 inline void disable_echo();
@@ -16,6 +23,175 @@ inline void disable_echo();
 unsigned char *com_readline();
 void com_print(const char *str);
 void com_println(const char *str);
+/*
+Start sending any buffered output now, without waiting for it to go out
+Output is otherwise sent when a packet fills, at a newline with echo on, or
+when waiting for input (com_readline() / com_cmd_prompt())
+*/
+void com_flush(void);
+
+/*
+Fill buf with the next len bytes of a com_stream()
+Must not print, output is held until the stream ends
+*/
+typedef void (*com_producer_t)(void *ctx, uint8_t *buf, uint8_t len);
+
+/*
+Send exactly len bytes from producer, filled straight into the USB packet
+buffers. Earlier buffered output is sent first. EP2 IN is ping-ponged so
+the next packet is produced while the previous one is on the bus.
+*/
+void com_stream(uint16_t len, com_producer_t producer, void *ctx);
+
+// Byte idx of a com_stream_hex()
+typedef uint8_t (*com_byte_source_t)(void *ctx, uint16_t idx);
+
+// Bytes per com_stream() in com_stream_hex()
+#define COM_STREAM_HEX_MAX 0x5000
+
+/*
+Stream count bytes from src, in order, as " XX" hex text
+*/
+void com_stream_hex(uint16_t count, com_byte_source_t src, void *ctx);
+// As com_stream_hex(), but "XX " like a printf("%02X ") loop
+void com_stream_hex_trailing(uint16_t count, com_byte_source_t src, void *ctx);
+
+// Data bytes per Intel HEX record
+#define COM_IHEX_RECORD 16
+#define COM_IHEX_LINE_MAX (13 + 2 * COM_IHEX_RECORD)
+
+/*
+Stream count bytes from src as Intel HEX data records starting at addr,
+followed by the EOF record. Checksums are accumulated as bytes are read.
+*/
+void com_stream_ihex(uint16_t addr, uint16_t count, com_byte_source_t src,
+                     void *ctx);
+
+// Print the low `digits` hex digits of val
+void com_print_hex(uint16_t val, uint8_t digits);
+
+/*
+Binary command frames
+
+A COM_FRAME_ESC byte where a command line would start begins a binary frame
+instead (see comlib.c for the layout). The vendor bulk interface carries
+the same frames with no console around them. The frame's op is looked up in the
+table given to com_frame_ops() and the handler answers with
+com_frame_reply() followed by exactly `len` bytes of com_frame_put() /
+com_frame_write(). A handler that doesn't reply answers COM_FRAME_OK with no
+data. Text printed while a frame is handled is dropped.
+*/
+#define COM_FRAME_ESC 0xA5
+// Largest request payload
+#define COM_FRAME_MAX 64
+
+#define COM_FRAME_OK    0
+#define COM_FRAME_E_CRC 1 /* bad CRC */
+#define COM_FRAME_E_LEN 2 /* payload too large */
+#define COM_FRAME_E_OP  3 /* unknown op */
+#define COM_FRAME_E_ARG 4 /* bad payload */
+#define COM_FRAME_E_CMD 5 /* command failed */
+
+// Little endian u16 from a frame payload
+#define COM_U16(p) ((uint16_t)((p)[0] | ((uint16_t)(p)[1] << 8)))
+
+typedef void (*com_frame_handler_t)(const uint8_t *req, uint16_t len);
+
+typedef struct com_frame_op {
+    uint8_t op;
+    com_frame_handler_t fn;
+} com_frame_op_t;
+
+// Sets the binary ops of the current mode
+void com_frame_ops(const com_frame_op_t *ops, uint8_t nops);
+void com_frame_reply(uint8_t status, uint16_t len);
+void com_frame_put(uint8_t b);
+void com_frame_write(const uint8_t *buf, uint16_t len);
+
+/*
+Session options: COM_FRAME_OP_OPTS with one byte of COM_FRAME_F_* flags.
+The reply carries the flags accepted, which apply to every later frame on
+either interface. Options frames themselves are never coded.
+*/
+#define COM_FRAME_OP_OPTS 0x3D /* '=' */
+// Run length coded payloads and replies, see comlib.c
+#define COM_FRAME_F_RLE 0x01
+#define COM_FRAME_F_ALL COM_FRAME_F_RLE
+
+/*
+Link self-tests, answered in every mode on either interface
+PING:   echoes its payload
+SOURCE: len (u16), seed (u8) => len bytes of seed, seed + 1, ... (no runs,
+        so RLE doesn't flatter it). len is at most COM_TEST_MAX.
+SINK:   len (u16) => window (u16), then a len byte write stream that is
+        thrown away
+*/
+#define COM_FRAME_OP_PING   0x21 /* '!' */
+#define COM_FRAME_OP_SOURCE 0x7D /* '}' */
+#define COM_FRAME_OP_SINK   0x7B /* '{' */
+#define COM_TEST_MAX        0xFFFE
+
+/*
+Credit based write streams
+
+A mode op that takes a large write calls com_wr_begin() and replies with the
+window it returns. The host then sends the data as COM_FRAME_OP_DATA frames
+(payload only, no reply) keeping at most `window` bytes unconsumed. As the
+sink consumes data the device sends COM_FRAME_OP_CREDIT frames, seq 0,
+carrying the consumed byte count (u16). A non OK status in one ends the
+stream, as does the credit frame covering the last byte. An aborted stream
+also ends the progress record, if one is running.
+*/
+#define COM_FRAME_OP_DATA   0x3E /* '>' */
+#define COM_FRAME_OP_CREDIT 0x3C /* '<' */
+// Receive buffer for write streams
+#define COM_WR_WINDOW 256
+
+/*
+Consume len bytes at stream offset off. May take its time (ex: programming),
+the host is held off by credit meanwhile. Text output is dropped.
+Return false to abort the stream.
+*/
+typedef bool (*com_wr_sink_t)(void *ctx, uint16_t off, const uint8_t *buf,
+                              uint16_t len);
+
+// Start a len byte write stream on the current frame's interface. Returns
+// the window
+uint16_t com_wr_begin(uint16_t len, com_wr_sink_t sink, void *ctx);
+
+/*
+Progress notifications
+
+While an operation runs, a record is sent on the CDC notification endpoint
+(EP1 IN) every COM_PROGRESS_MS, paced by USB start of frame, plus a final
+one when it ends. It is shaped like a CDC notification so the ACM driver
+ignores it:
+
+0  bmRequestType 0xA1
+1  bNotification COM_NOTIFY_PROGRESS
+2  wValue 0, wIndex 0 (communication interface), wLength 8
+8  op (the command letter), state (COM_PROGRESS_*)
+10 addr, total, errors (u16 little endian)
+*/
+#define COM_NOTIFY_ENDPOINT 1
+#define COM_NOTIFY_PROGRESS 0xF0
+#define COM_PROGRESS_MS     50
+
+#define COM_PROGRESS_IDLE    0
+#define COM_PROGRESS_RUNNING 1
+#define COM_PROGRESS_DONE    2
+
+void com_progress_begin(uint8_t op, uint16_t total);
+// Cheap enough to call for every byte, nothing is sent from here
+void com_progress(uint16_t addr, uint16_t errors);
+// A no-op unless a record is running
+void com_progress_end(void);
+
+// USB start of frame, from the USB ISR
+void com_sof(void);
+
+// USB IN transaction complete, from the USB ISR
+void com_in_complete(uint8_t endpoint);
 
 // xc18 can't handle
 // #define com_printfln(s, ...) printf(s "\r\n", __VA_ARGS__)
@@ -28,4 +204,30 @@ char *com_cmd_prompt(void);
 
 extern unsigned comblib_drops;
 
+/*
+USB link statistics, per endpoint number. No counter is updated from the
+ISR and mode code at the same time (EP2 IN is counted with interrupts
+masked, or by com_stream() while the ISR leaves it alone), so counts are
+never lost, but a print racing the ISR may show a torn value.
+*/
+#define COM_STATS_EPS 4
+
+typedef struct com_stats {
+    uint16_t in_packets;
+    // IN packets shorter than the endpoint size (ends of transfers)
+    uint16_t in_short;
+    uint32_t in_bytes;
+    uint16_t out_packets;
+    uint32_t out_bytes;
+    // Polls of a busy IN endpoint or full output ring
+    uint32_t busy_spins;
+    // Halts seen set (EP2 / EP3 only, polled while waiting for input)
+    uint16_t halts;
+} com_stats_t;
+
+extern com_stats_t com_stats[COM_STATS_EPS];
+
+// Print the counters (and command line overflows), then zero them
+void com_stats_print(void);
+
 #endif
@@ -11,92 +11,240 @@
 #include <stdio.h>
 #include <string.h>
 
-#define D40_MASK(n) (1 << (((n)-1) % 8))
-#define D40_OFF(n)  (((n)-1) / 8)
-
-// Direction
-zif_bits_t ezzif_zbd = {0};
-// Output
-zif_bits_t ezzif_zbo = {0};
-zif_bits_t ezzif_zb_vpp = {0};
-zif_bits_t ezzif_zb_vdd = {0};
-zif_bits_t ezzif_zb_gnd = {0};
+/*
+Pin direction and output values live in TRISx / LATx only; there is no ZIF
+order copy. Rail assignments are kept in ZIF order for power_plan_apply(),
+plus a port order union so a pin direction change is checked in O(1)
+
+Between ezzif_begin() and ezzif_commit() changes go to a stage instead:
+pin state in port layout, rails as a power plan. The commit checks
+everything once and applies it in one latch pass and one port pass
+*/
+static power_plan_t rails;
+static port_bits_t rail_ports;
+// Pins each rail can reach, from the io.c latch maps
+static power_plan_t caps;
+static unsigned char caps_valid;
+
+static unsigned char txn_depth;
+static power_plan_t stage;
+static port_bits_t stage_lat;
+static port_bits_t stage_tris;
+static unsigned char stage_rails;
+#define STAGE_EN_VDD 0x01
+#define STAGE_EN_VPP 0x02
+static unsigned char stage_en;
+
+static unsigned char pkg_npins;
+
 zif_bits_t ezzif_zb_read = {0};
 
 const_zif_bits_t ezzif_zero = {0, 0, 0, 0, 0};
 
 static int has_error = 0;
 
-// Verify no pin has two drivers
-int is_vsafe(void)
-{
-    for (unsigned i = 0; i < 5; ++i) {
-        unsigned char checks[4];
-
-        // tristate => don't drive
-        checks[0] = ezzif_zbd[i] ^ 0xFF;
-        checks[1] = ezzif_zb_vpp[i];
-        checks[2] = ezzif_zb_vdd[i];
-        checks[3] = ezzif_zb_gnd[i];
-
-        for (unsigned j = 0; j < sizeof(checks); ++j) {
-            for (unsigned k = 0; k < sizeof(checks); ++k) {
-                if (j != k && (checks[j] & checks[k])) {
-                    printf("ERROR: is_vsafe(), i %d, j %d => %02X, k %d => "
-                           "%02X\r\n",
-                           i, j, checks[j], k, checks[k]);
-                    has_error = 1;
-                    return 0;
-                }
-            }
+static void rails_to_ports(const power_plan_t *plan, port_bits_t ports)
+{
+    zif_bits_t all;
+
+    for (unsigned char i = 0; i < 5; ++i) {
+        all[i] = plan->vpp[i] | plan->vdd[i] | plan->gnd[i];
+    }
+    memset(ports, 0, sizeof(port_bits_t));
+    zif_pins_to_ports(all, ports);
+}
+
+// Pins in `mask` of `bank` are about to be driven
+static int is_drive_safe(const port_bits_t ports, unsigned char bank,
+                         unsigned char mask)
+{
+    if (ports[bank] & mask) {
+        printf("ERROR: is_vsafe(), bank %u mask %02X on a rail\r\n", bank,
+               ports[bank] & mask);
+        has_error = 1;
+        return 0;
+    }
+    return 1;
+}
+
+/*
+Verify the staged state: every rail pin can reach its rail, no pin is on two
+rails, and no pin on a rail is also driven by the MCU
+Fills `ports` with the staged rail pins in port layout
+*/
+static int is_vsafe(port_bits_t ports)
+{
+    for (unsigned char i = 0; i < 5; ++i) {
+        unsigned char vpp = stage.vpp[i];
+        unsigned char vdd = stage.vdd[i];
+        unsigned char gnd = stage.gnd[i];
+        unsigned char bad;
+
+        bad = (vpp & ~caps.vpp[i]) | (vdd & ~caps.vdd[i]) |
+              (gnd & ~caps.gnd[i]);
+        if (bad) {
+            printf("ERROR: is_vsafe(), i %u => %02X can't reach rail\r\n", i,
+                   bad);
+            has_error = 1;
+            return 0;
+        }
+        bad = (vpp & vdd) | (vpp & gnd) | (vdd & gnd);
+        if (bad) {
+            printf("ERROR: is_vsafe(), i %u => %02X on two rails\r\n", i, bad);
+            has_error = 1;
+            return 0;
+        }
+    }
+
+    rails_to_ports(&stage, ports);
+    // TRIS 0 => driven by the MCU
+    for (unsigned char bank = 0; bank < 9; ++bank) {
+        unsigned char driven = ~stage_tris[bank] & zif_port_mask[bank];
+
+        if (!is_drive_safe(ports, bank, driven)) {
+            return 0;
         }
     }
     return 1;
 }
 
+static void caps_init(void)
+{
+    if (!caps_valid) {
+        power_caps(&caps);
+        caps_valid = 1;
+    }
+}
+
+void ezzif_begin(void)
+{
+    if (txn_depth++) {
+        return;
+    }
+
+    caps_init();
+    stage = rails;
+    for (unsigned char bank = 0; bank < 9; ++bank) {
+        stage_lat[bank] = *lat_regs[bank];
+        stage_tris[bank] = *tris_regs[bank];
+    }
+    stage_rails = 0;
+    stage_en = 0;
+}
+
+int ezzif_commit(void)
+{
+    port_bits_t ports;
+
+    if (!txn_depth || --txn_depth) {
+        return 0;
+    }
+
+    if (stage_rails) {
+        if (!is_vsafe(ports)) {
+            return -1;
+        }
+    } else {
+        // Rails unchanged, only newly driven pins need checking
+        for (unsigned char bank = 0; bank < 9; ++bank) {
+            unsigned char driven = ~stage_tris[bank] & zif_port_mask[bank];
+
+            if (!is_drive_safe(rail_ports, bank, driven)) {
+                return -1;
+            }
+        }
+    }
+
+    vid_settle_wait();
+    // Values first, and release pins before the rails move
+    for (unsigned char bank = 0; bank < 9; ++bank) {
+        unsigned char mask = zif_port_mask[bank];
+
+        if (!mask) {
+            continue;
+        }
+        *lat_regs[bank] = (*lat_regs[bank] & ~mask) | (stage_lat[bank] & mask);
+        *tris_regs[bank] |= stage_tris[bank] & mask;
+    }
+
+    if (stage_rails) {
+        rails = stage;
+        memcpy(rail_ports, ports, sizeof(rail_ports));
+        power_plan_apply(&rails);
+    }
+
+    // Then drive
+    for (unsigned char bank = 0; bank < 9; ++bank) {
+        unsigned char mask = zif_port_mask[bank];
+
+        if (!mask) {
+            continue;
+        }
+        *tris_regs[bank] &= stage_tris[bank] | ~mask;
+    }
+
+    if (stage_en & STAGE_EN_VDD) {
+        vdd_en();
+    }
+    if (stage_en & STAGE_EN_VPP) {
+        vpp_en();
+    }
+    return 0;
+}
+
 void ezzif_reset(void)
 {
     has_error = 0;
+    txn_depth = 0;
+    // Package selection survives resets
+    if (!pkg_npins) {
+        ezzif_package(EZZIF_PACKAGE_DEFAULT);
+    }
 
     // Disable pullup/pulldown
     pupd(1, 0);
 
-    // ezzif_zbd = {0};
     // tristate all pins
-    memset(ezzif_zbd, 0xFF, sizeof(ezzif_zbd));
-    dir_write(ezzif_zbd);
+    zif_bits_t zb;
+    memset(zb, 0xFF, sizeof(zb));
+    dir_write(zb);
 
-    memset(ezzif_zbo, 0, sizeof(ezzif_zbo));
-    zif_write(ezzif_zbo);
+    memset(zb, 0, sizeof(zb));
+    zif_write(zb);
 
-    ezzif_reset_vpp();
-    ezzif_reset_vdd();
-    ezzif_reset_gnd();
+    vpp_dis();
+    vdd_dis();
+    memset(&rails, 0, sizeof(rails));
+    memset(rail_ports, 0, sizeof(rail_ports));
 
-    // Make sure?
-    for (unsigned i = 0; i < 8; ++i) {
-        write_latch(i, 0x00);
-    }
+    // All three rails in one latch pass
+    power_plan_apply(&rails);
 }
 
 void ezzif_reset_vpp(void)
 {
-    memset(ezzif_zb_vpp, 0, sizeof(ezzif_zb_vpp));
-    set_vpp(ezzif_zb_vpp);
+    ezzif_begin();
+    memset(stage.vpp, 0, sizeof(stage.vpp));
+    stage_rails = 1;
+    ezzif_commit();
     vpp_dis();
 }
 
 void ezzif_reset_vdd(void)
 {
-    memset(ezzif_zb_vdd, 0, sizeof(ezzif_zb_vdd));
-    set_vdd(ezzif_zb_vdd);
+    ezzif_begin();
+    memset(stage.vdd, 0, sizeof(stage.vdd));
+    stage_rails = 1;
+    ezzif_commit();
     vdd_dis();
 }
 
 void ezzif_reset_gnd(void)
 {
-    memset(ezzif_zb_gnd, 0, sizeof(ezzif_zb_gnd));
-    set_gnd(ezzif_zb_gnd);
+    ezzif_begin();
+    memset(stage.gnd, 0, sizeof(stage.gnd));
+    stage_rails = 1;
+    ezzif_commit();
 }
 
 int ezzif_error(void)
@@ -121,13 +269,16 @@ void ezzif_print_debug(void)
 
     printf("\r\n");
 
-    print_zif_bits("  ezzif dir", ezzif_zbd);
-    print_zif_bits("  ezzif out", ezzif_zbo);
+    zif_bits_t zb;
+    dir_read(zb);
+    print_zif_bits("  ezzif dir", zb);
+    zif_lat_read(zb);
+    print_zif_bits("  ezzif out", zb);
     ezzif_read();
     print_zif_bits("  ezzif read", ezzif_zb_read);
-    print_zif_bits("  ezzif VPP", ezzif_zb_vpp);
-    print_zif_bits("  ezzif VDD", ezzif_zb_vdd);
-    print_zif_bits("  ezzif GND", ezzif_zb_gnd);
+    print_zif_bits("  ezzif VPP", rails.vpp);
+    print_zif_bits("  ezzif VDD", rails.vdd);
+    print_zif_bits("  ezzif GND", rails.gnd);
 
     printf("\r\n");
 
@@ -169,64 +320,123 @@ int ezzif_assert_d40(int n)
     }
 }
 
-void ezzif_toggle_d40(int n)
-{
-    int ni = n - 1;
-    int off = ni / 8;
-    int mask = 1 << (ni % 8);
+/*
+Pin accesses go straight to the pin's port register, or to the stage inside
+a transaction. A vpp_val() / vdd_val() made while a rail is enabled is still
+settling, so direct drives wait it out like PINVM_OP_PW (free otherwise)
+*/
 
-    if (!ezzif_assert_d40(n)) {
-        return;
+static volatile unsigned char *pin_lat(unsigned char bank)
+{
+    if (txn_depth) {
+        return &stage_lat[bank];
     }
+    vid_settle_wait();
+    return lat_regs[bank];
+}
 
-    ezzif_zbo[off] ^= mask;
-    zif_write(ezzif_zbo);
+static void pin_toggle(port_pin_t pin)
+{
+    *pin_lat(pin.bank) ^= pin.mask;
 }
 
-void ezzif_w_d40(int n, int val)
+static void pin_w(port_pin_t pin, int val)
 {
-    int ni = n - 1;
-    int off = ni / 8;
-    int mask = 1 << (ni % 8);
-    int delta;
+    if (val) {
+        *pin_lat(pin.bank) |= pin.mask;
+    } else {
+        *pin_lat(pin.bank) &= ~pin.mask;
+    }
+}
 
-    if (!ezzif_assert_d40(n)) {
-        return;
+static void pin_dir(port_pin_t pin, int tristate)
+{
+    if (txn_depth) {
+        // Checked at commit
+        if (tristate) {
+            stage_tris[pin.bank] |= pin.mask;
+        } else {
+            stage_tris[pin.bank] &= ~pin.mask;
+        }
+    } else if (tristate) {
+        *tris_regs[pin.bank] |= pin.mask;
+    } else {
+        if (!is_drive_safe(rail_ports, pin.bank, pin.mask)) {
+            return;
+        }
+        vid_settle_wait();
+        *tris_regs[pin.bank] &= ~pin.mask;
     }
+}
 
-    delta = (ezzif_zbo[off] & mask) ^ (val ? mask : 0);
-    if (delta) {
-        ezzif_zbo[off] = ezzif_zbo[off] ^ delta;
-        zif_write(ezzif_zbo);
+static void pin_io(port_pin_t pin, int tristate, int val)
+{
+    pin_dir(pin, tristate);
+    if (!tristate) {
+        pin_w(pin, val);
     }
 }
 
-void ezzif_dir_d40(int n, int tristate)
+static int pin_r(port_pin_t pin)
 {
-    int ni = n - 1;
-    int off = ni / 8;
-    int mask = 1 << (ni % 8);
-    int delta;
+    return *port_regs[pin.bank] & pin.mask ? 1 : 0;
+}
 
-    if (!ezzif_assert_d40(n)) {
-        return;
+// ni: 0 based ZIF pin
+static void rail_vdd(unsigned char ni, int voltset)
+{
+    ezzif_begin();
+    vdd_val(voltset);
+    stage.vdd[ni / 8] |= 1 << (ni % 8);
+    stage_rails = 1;
+    stage_en |= STAGE_EN_VDD;
+    ezzif_commit();
+}
+
+static void rail_vpp(unsigned char ni, int voltset)
+{
+    ezzif_begin();
+    vpp_val(voltset);
+    stage.vpp[ni / 8] |= 1 << (ni % 8);
+    stage_rails = 1;
+    // VDD required for VPP?
+    stage_en |= STAGE_EN_VDD | STAGE_EN_VPP;
+    ezzif_commit();
+}
+
+static void rail_gnd(unsigned char ni)
+{
+    ezzif_begin();
+    stage.gnd[ni / 8] |= 1 << (ni % 8);
+    stage_rails = 1;
+    ezzif_commit();
+}
+
+void ezzif_toggle_d40(int n)
+{
+    if (ezzif_assert_d40(n)) {
+        pin_toggle(zif2pin[n - 1]);
     }
+}
 
-    delta = (ezzif_zbd[off] & mask) ^ (tristate ? mask : 0);
-    if (delta) {
-        ezzif_zbd[off] = ezzif_zbd[off] ^ delta;
-        if (!is_vsafe()) {
-            return;
-        }
-        dir_write(ezzif_zbd);
+void ezzif_w_d40(int n, int val)
+{
+    if (ezzif_assert_d40(n)) {
+        pin_w(zif2pin[n - 1], val);
+    }
+}
+
+void ezzif_dir_d40(int n, int tristate)
+{
+    if (ezzif_assert_d40(n)) {
+        pin_dir(zif2pin[n - 1], tristate);
     }
 }
 
 void ezzif_io_d40(int n, int tristate, int val)
 {
-    ezzif_dir_d40(n, tristate);
-    if (!tristate) {
-        ezzif_w_d40(n, val);
+    if (ezzif_assert_d40(n)) {
+        pin_io(zif2pin[n - 1], tristate, val);
     }
 }
 
@@ -242,13 +452,10 @@ void ezzif_i_d40(int n)
 
 int ezzif_r_d40(int n)
 {
-    zif_bits_t zb;
-    int ni = n - 1;
-    int off = ni / 8;
-    int mask = 1 << (ni % 8);
-
-    zif_read(zb);
-    return zb[off] & mask ? 1 : 0;
+    if (!ezzif_assert_d40(n)) {
+        return 0;
+    }
+    return pin_r(zif2pin[n - 1]);
 }
 
 void zif_bit_d40(zif_bits_t zb, int n)
@@ -260,91 +467,249 @@ void zif_bit_d40(zif_bits_t zb, int n)
 
 void ezzif_vdd_d40(int n, int voltset)
 {
-    vdd_val(voltset);
-
-    zif_bit_d40(ezzif_zb_vdd, n);
-    if (!is_vsafe()) {
-        return;
+    if (ezzif_assert_d40(n)) {
+        rail_vdd(n - 1, voltset);
     }
-    set_vdd(ezzif_zb_vdd);
-    vdd_en();
 }
 
 void ezzif_vpp_d40(int n, int voltset)
 {
-    vpp_val(voltset);
-
-    zif_bit_d40(ezzif_zb_vpp, n);
-    if (!is_vsafe()) {
-        return;
+    if (ezzif_assert_d40(n)) {
+        rail_vpp(n - 1, voltset);
     }
-    set_vpp(ezzif_zb_vpp);
-    // VDD required for VPP?
-    vdd_en();
-    vpp_en();
 }
 
 void ezzif_gnd_d40(int n)
 {
-    zif_bit_d40(ezzif_zb_gnd, n);
-    if (!is_vsafe()) {
-        return;
+    if (ezzif_assert_d40(n)) {
+        rail_gnd(n - 1);
     }
-    set_gnd(ezzif_zb_gnd);
 }
 
-void ezzif_bus_dir_d40(const char *ns, unsigned len, int tristate)
+int ezzif_bus_init_d40(zif_bus_t *bus, const char *ns, unsigned len)
 {
-    for (unsigned i = 0; i < len; ++i) {
-        ezzif_dir_d40(ns[i], tristate);
+    if (zif_bus_init(bus, ns, len)) {
+        printf("ERROR: ezzif_bus_init_d40()\r\n");
+        has_error = 1;
+        return -1;
     }
+    return 0;
 }
 
-void ezzif_bus_w_d40(const char *ns, unsigned len, uint16_t val)
+void ezzif_bus_dir(const zif_bus_t *bus, int tristate)
 {
-    for (unsigned i = 0; i < len; ++i) {
-        ezzif_w_d40(ns[i], (val & (1 << i)) != 0);
+    if (txn_depth) {
+        for (unsigned char b = 0; b < bus->nbanks; ++b) {
+            if (tristate) {
+                stage_tris[bus->banks[b]] |= bus->masks[b];
+            } else {
+                stage_tris[bus->banks[b]] &= ~bus->masks[b];
+            }
+        }
+        return;
     }
+    if (!tristate) {
+        for (unsigned char b = 0; b < bus->nbanks; ++b) {
+            if (!is_drive_safe(rail_ports, bus->banks[b], bus->masks[b])) {
+                return;
+            }
+        }
+    }
+    zif_bus_dir(bus, tristate);
 }
 
-uint16_t ezzif_bus_r_d40(const char *ns, unsigned len)
+void ezzif_bus_w(const zif_bus_t *bus, uint16_t val)
 {
-    int ret = 0;
+    if (txn_depth) {
+        unsigned char out[ZIF_BUS_BANKS];
 
-    for (unsigned i = 0; i < len; ++i) {
-        if (ezzif_r_d40(ns[i])) {
-            ret |= 1 << i;
+        zif_bus_scatter(bus, val, out);
+        for (unsigned char b = 0; b < bus->nbanks; ++b) {
+            unsigned char bank = bus->banks[b];
+            stage_lat[bank] = (stage_lat[bank] & ~bus->masks[b]) | out[b];
         }
+        return;
     }
-    return ret;
+    zif_bus_w(bus, val);
+}
+
+void ezzif_bus_step(const zif_bus_t *bus, uint16_t from, uint16_t to)
+{
+    if (txn_depth) {
+        ezzif_bus_w(bus, to);
+        return;
+    }
+    zif_bus_step(bus, from, to);
+}
+
+uint16_t ezzif_bus_r(const zif_bus_t *bus)
+{
+    return zif_bus_r(bus);
 }
 
 /****************************************************************************
 Generic DIP
 ****************************************************************************/
 
-void ezzif_bus_dir(const char *ns, unsigned len, int tristate)
+/*
+DIP pin n of the selected package, precomputed by ezzif_package() so the
+DIP API costs the same as the d40 one
+Index 0 is unused
+*/
+#define PKG_CAP_VPP 0x01
+#define PKG_CAP_VDD 0x02
+#define PKG_CAP_GND 0x04
+
+static unsigned char pkg_zif[41];   /* 1 based ZIF pin */
+static port_pin_t pkg_pin[41];
+static unsigned char pkg_caps[41];  /* PKG_CAP_* */
+
+static unsigned char zb_has(const zif_bits_t zb, unsigned char ni)
 {
-    for (unsigned i = 0; i < len; ++i) {
-        ezzif_dir(ns[i], tristate);
+    return zb[ni / 8] & (1 << (ni % 8)) ? 1 : 0;
+}
+
+int ezzif_package(unsigned npins)
+{
+    if (npins < 8 || npins > 40 || (npins & 1)) {
+        printf("ERROR: ezzif_package(%u)\r\n", npins);
+        has_error = 1;
+        return -1;
     }
+
+    caps_init();
+    memset(pkg_zif, 0, sizeof(pkg_zif));
+    memset(pkg_caps, 0, sizeof(pkg_caps));
+    pkg_npins = npins;
+    // Pin 1 in ZIF pin 1: the low half maps straight across, the high half
+    // ends at ZIF pin 40
+    for (unsigned char n = 1; n <= npins; ++n) {
+        unsigned char z = n <= npins / 2 ? n : n + 40 - npins;
+        unsigned char ni = z - 1;
+
+        pkg_zif[n] = z;
+        pkg_pin[n] = zif2pin[ni];
+        pkg_caps[n] = (zb_has(caps.vpp, ni) ? PKG_CAP_VPP : 0) |
+                      (zb_has(caps.vdd, ni) ? PKG_CAP_VDD : 0) |
+                      (zb_has(caps.gnd, ni) ? PKG_CAP_GND : 0);
+    }
+    return 0;
 }
 
-void ezzif_bus_w(const char *ns, unsigned len, uint16_t val)
+unsigned ezzif_package_pins(void)
 {
-    for (unsigned i = 0; i < len; ++i) {
-        ezzif_w(ns[i], (val & (1 << i)) != 0);
+    return pkg_npins;
+}
+
+int ezzif_dipto40(int n)
+{
+    return n >= 1 && n <= pkg_npins ? pkg_zif[n] : 0;
+}
+
+static int ezzif_assert(int n)
+{
+    if (n >= 1 && n <= pkg_npins) {
+        return 1;
+    }
+    printf("ERROR: ezzif_assert(%d), DIP%u\r\n", n, pkg_npins);
+    has_error = 1;
+    return 0;
+}
+
+static int ezzif_assert_cap(int n, unsigned char cap)
+{
+    if (!ezzif_assert(n)) {
+        return 0;
+    }
+    if (!(pkg_caps[n] & cap)) {
+        printf("ERROR: DIP%u pin %d can't reach rail\r\n", pkg_npins, n);
+        has_error = 1;
+        return 0;
+    }
+    return 1;
+}
+
+void ezzif_toggle(int n)
+{
+    if (ezzif_assert(n)) {
+        pin_toggle(pkg_pin[n]);
+    }
+}
+
+void ezzif_w(int n, int val)
+{
+    if (ezzif_assert(n)) {
+        pin_w(pkg_pin[n], val);
+    }
+}
+
+void ezzif_dir(int n, int tristate)
+{
+    if (ezzif_assert(n)) {
+        pin_dir(pkg_pin[n], tristate);
+    }
+}
+
+void ezzif_io(int n, int tristate, int val)
+{
+    if (ezzif_assert(n)) {
+        pin_io(pkg_pin[n], tristate, val);
+    }
+}
+
+void ezzif_o(int n, int val)
+{
+    ezzif_io(n, 1, val);
+}
+
+void ezzif_i(int n)
+{
+    ezzif_io(n, 0, 0);
+}
+
+int ezzif_r(int n)
+{
+    if (!ezzif_assert(n)) {
+        return 0;
     }
+    return pin_r(pkg_pin[n]);
 }
 
-uint16_t ezzif_bus_r(const char *ns, unsigned len)
+void ezzif_vdd(int n, int voltset)
 {
-    int ret = 0;
+    if (ezzif_assert_cap(n, PKG_CAP_VDD)) {
+        rail_vdd(pkg_zif[n] - 1, voltset);
+    }
+}
 
+void ezzif_vpp(int n, int voltset)
+{
+    if (ezzif_assert_cap(n, PKG_CAP_VPP)) {
+        rail_vpp(pkg_zif[n] - 1, voltset);
+    }
+}
+
+void ezzif_gnd(int n)
+{
+    if (ezzif_assert_cap(n, PKG_CAP_GND)) {
+        rail_gnd(pkg_zif[n] - 1);
+    }
+}
+
+int ezzif_bus_init(zif_bus_t *bus, const char *ns, unsigned len)
+{
+    char ns40[ZIF_BUS_MAX];
+
+    if (len > ZIF_BUS_MAX) {
+        printf("ERROR: ezzif_bus_init()\r\n");
+        has_error = 1;
+        return -1;
+    }
     for (unsigned i = 0; i < len; ++i) {
-        if (ezzif_r(ns[i])) {
-            ret |= 1 << i;
+        if (!ezzif_assert(ns[i])) {
+            return -1;
         }
+        ns40[i] = pkg_zif[(unsigned char)ns[i]];
     }
-    return ret;
+    return ezzif_bus_init_d40(bus, ns40, len);
 }
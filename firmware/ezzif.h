@@ -9,7 +9,6 @@ functions You should not use low level APIs unless you know what you are doing
 #include "io.h"
 #include <stdint.h>
 
-#define EZZIF_D28
 // #include "defines.h"
 
 // High level API
@@ -19,6 +18,12 @@ void ezzif_reset(void);
 void ezzif_reset_vpp(void);
 void ezzif_reset_vdd(void);
 void ezzif_reset_gnd(void);
+// Group changes: between begin and commit, pin, direction and rail changes
+// are only staged. The commit checks them once and applies them in one latch
+// and port pass. Nests; only the outermost commit applies
+// Returns 0 on success, otherwise nothing is applied and the error is set
+void ezzif_begin(void);
+int ezzif_commit(void);
 // Check if an error has occured and clear error status
 // Returns 0 on success, otherwise an error code
 // Ex: an invalid pin number
@@ -27,10 +32,8 @@ int ezzif_error(void);
 void ezzif_print_debug(void);
 
 // Low level API
-// Direction buffer
-extern zif_bits_t ezzif_zbd;
-// Output buffer
-extern zif_bits_t ezzif_zbo;
+// Pin direction and output state is held in TRISx / LATx, use dir_read() and
+// zif_lat_read() to get it in ZIF order
 
 /****************************************************************************
 DIP40
@@ -62,54 +65,51 @@ void ezzif_gnd_d40(int n);
 // Set given bit in zb
 void zif_bit_d40(zif_bits_t zb, int n);
 
-void ezzif_bus_dir_d40(const char *ns, unsigned len, int tristate);
-void ezzif_bus_w_d40(const char *ns, unsigned len, uint16_t val);
-uint16_t ezzif_bus_r_d40(const char *ns, unsigned len);
+/*
+Bus functions
+Build a bus once from a pin array (LSB first, at most ZIF_BUS_MAX pins), then
+use it for every access. Returns 0 on success
+*/
+int ezzif_bus_init_d40(zif_bus_t *bus, const char *ns, unsigned len);
 
 /****************************************************************************
 Generic DIP
-TODO: convert these to ni directly instead of DIP28 => d40 => ni
+Pin numbers are for the package selected with ezzif_package(), inserted with
+pin 1 in ZIF pin 1
 ****************************************************************************/
 
-// preprocess to propagate constants
-#define ezzif_dip_40to40(n) (n)
-// Pin 1 => 1
-// Pin 28 => 40, etc
-#define ezzif_dip_28to40(n) ((n) <= 14 ? (n) : (n) + 40 - 28)
+#define EZZIF_PACKAGE_DEFAULT 28
 
-#if defined(EZZIF_D40)
-#define ezzif_dipto40 ezzif_dip_40to40
-#elif defined(EZZIF_D28)
-#define ezzif_dipto40 ezzif_dip_28to40
-#else
-#error "Must define EZZIF_DIPN"
-#endif
+// Select DIP package, 8 to 40 pins, even. Kept across ezzif_reset()
+// Returns 0 on success
+int ezzif_package(unsigned npins);
+unsigned ezzif_package_pins(void);
+// DIP pin => ZIF pin, 0 if not in the package
+int ezzif_dipto40(int n);
 
 // High level API
 // See d40 API for definitions
-#define ezzif_toggle(n)            ezzif_toggle_d40(ezzif_dipto40(n))
-#define ezzif_w(n, val)            ezzif_w_d40(ezzif_dipto40(n), val)
-#define ezzif_dir(n, tristate)     ezzif_dir_d40(ezzif_dipto40(n), tristate)
-#define ezzif_io(n, tristate, val) ezzif_io_d40(ezzif_dipto40(n), tristate, val)
-#define ezzif_o(n, val)            ezzif_o_d40(ezzif_dipto40(n), val)
-#define ezzif_i(n)                 ezzif_i_d40(ezzif_dipto40(n))
-#define ezzif_r(n)                 ezzif_r_d40(ezzif_dipto40(n))
-#define ezzif_vdd(n, voltset)      ezzif_vdd_d40(ezzif_dipto40(n), voltset)
-#define ezzif_vpp(n, voltset)      ezzif_vpp_d40(ezzif_dipto40(n), voltset)
-#define ezzif_gnd(n)               ezzif_gnd_d40(ezzif_dipto40(n))
+// ezzif_vdd/vpp/gnd also reject pins that can't reach the rail
+void ezzif_toggle(int n);
+void ezzif_w(int n, int val);
+void ezzif_dir(int n, int tristate);
+void ezzif_io(int n, int tristate, int val);
+void ezzif_o(int n, int val);
+void ezzif_i(int n);
+int ezzif_r(int n);
+void ezzif_vdd(int n, int voltset);
+void ezzif_vpp(int n, int voltset);
+void ezzif_gnd(int n);
 
-/*
-Bus functions
-ns: pin array
-    LSB first
-    No more than int size
-len: array length
-*/
-// Set source / sink on given pins
-void ezzif_bus_dir(const char *ns, unsigned len, int tristate);
-// Set given pins to value (0 or 1)
-void ezzif_bus_w(const char *ns, unsigned len, uint16_t val);
-// Read value on given pins
-uint16_t ezzif_bus_r(const char *ns, unsigned len);
+// Bus functions, see d40 API. Pin numbers are for the DIP package
+int ezzif_bus_init(zif_bus_t *bus, const char *ns, unsigned len);
+// Set source / sink on all bus pins
+void ezzif_bus_dir(const zif_bus_t *bus, int tristate);
+// Set bus pins to value, bit 0 => ns[0]
+void ezzif_bus_w(const zif_bus_t *bus, uint16_t val);
+// Move bus pins from the last written value to a new one, see zif_bus_step()
+void ezzif_bus_step(const zif_bus_t *bus, uint16_t from, uint16_t to);
+// Read value on bus pins
+uint16_t ezzif_bus_r(const zif_bus_t *bus);
 
 #endif
@@ -7,73 +7,144 @@
 
 #include "comlib.h"
 #include "io.h"
+#include "prof.h"
 #include "system.h"
+#include "timer.h"
+#include "trace.h"
+#include "zif_lut.h"
 
 latch_bits_t latch_cache = {0};
 
-#define OFFS_A 0
-#define OFFS_B 1
-#define OFFS_C 2
-#define OFFS_D 3
-#define OFFS_E 4
-#define OFFS_F 5
-#define OFFS_G 6
-#define OFFS_H 7
-#define OFFS_J 8
+#ifdef TRACE
+// Record the bytes of a ZIF write that changed since the last one
+static void trace_zif(uint8_t id, zif_bits_t last, const_zif_bits_t zif)
+{
+    for (unsigned char i = 0; i < 5; i++) {
+        if (zif[i] != last[i]) {
+            last[i] = zif[i];
+            trace_event(id + i, zif[i]);
+        }
+    }
+}
+
+static zif_bits_t trace_zif_lat;
+// TRIS resets to all inputs
+static zif_bits_t trace_zif_tris = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+#define TRACE_ZIF(id, last, zif) trace_zif(id, last, zif)
+#else
+#define TRACE_ZIF(id, last, zif)
+#endif
+
+static void vid_settle_wait_driven(void);
 
 /* ZIF pin assignments are scattered all over the PIC18's I/O banks.
  * This array provides a mapping from a ZIF pin to the corresponding PIC18
- * I/O location (0-based port bank addressing, and bit offset). */
+ * I/O location (0-based port bank addressing, and bit offset).
+ * The mapping itself lives in zif_lut.h so the lookup tables can share it. */
 const port_info_t zif2port[40] = {
     // 1-8
-    {OFFS_C, 5},
-    {OFFS_C, 4},
-    {OFFS_C, 3},
-    {OFFS_C, 2},
-    {OFFS_J, 7},
-    {OFFS_J, 6},
-    {OFFS_C, 6},
-    {OFFS_C, 7},
+    ZIF2PORT(1),
+    ZIF2PORT(2),
+    ZIF2PORT(3),
+    ZIF2PORT(4),
+    ZIF2PORT(5),
+    ZIF2PORT(6),
+    ZIF2PORT(7),
+    ZIF2PORT(8),
 
     // 9-16
-    {OFFS_J, 4},
-    {OFFS_J, 5},
-    {OFFS_G, 3},
-    {OFFS_G, 2},
-    {OFFS_D, 0},
-    {OFFS_D, 1},
-    {OFFS_D, 2},
-    {OFFS_G, 1},
+    ZIF2PORT(9),
+    ZIF2PORT(10),
+    ZIF2PORT(11),
+    ZIF2PORT(12),
+    ZIF2PORT(13),
+    ZIF2PORT(14),
+    ZIF2PORT(15),
+    ZIF2PORT(16),
 
     // 17-24
-    {OFFS_E, 0},
-    {OFFS_E, 7},
-    {OFFS_E, 2},
-    {OFFS_E, 3},
-    {OFFS_E, 4},
-    {OFFS_E, 5},
-    {OFFS_E, 6},
-    {OFFS_E, 1},
+    ZIF2PORT(17),
+    ZIF2PORT(18),
+    ZIF2PORT(19),
+    ZIF2PORT(20),
+    ZIF2PORT(21),
+    ZIF2PORT(22),
+    ZIF2PORT(23),
+    ZIF2PORT(24),
 
     // 25-32
-    {OFFS_D, 3},
-    {OFFS_D, 4},
-    {OFFS_D, 5},
-    {OFFS_D, 6},
-    {OFFS_D, 7},
-    {OFFS_G, 0},
-    {OFFS_J, 0},
-    {OFFS_J, 1},
+    ZIF2PORT(25),
+    ZIF2PORT(26),
+    ZIF2PORT(27),
+    ZIF2PORT(28),
+    ZIF2PORT(29),
+    ZIF2PORT(30),
+    ZIF2PORT(31),
+    ZIF2PORT(32),
 
     // 33-40
-    {OFFS_J, 2},
-    {OFFS_J, 3},
-    {OFFS_B, 2},
-    {OFFS_B, 3},
-    {OFFS_B, 4},
-    {OFFS_B, 5},
-    {OFFS_B, 6},
-    {OFFS_B, 7},
+    ZIF2PORT(33),
+    ZIF2PORT(34),
+    ZIF2PORT(35),
+    ZIF2PORT(36),
+    ZIF2PORT(37),
+    ZIF2PORT(38),
+    ZIF2PORT(39),
+    ZIF2PORT(40),
+};
+
+/* Same mapping as zif2port, with the bit offset pre-shifted into a mask so
+ * single pin accesses don't pay for a variable shift. */
+const port_pin_t zif2pin[40] = {
+    // 1-8
+    ZIF2PIN(1),
+    ZIF2PIN(2),
+    ZIF2PIN(3),
+    ZIF2PIN(4),
+    ZIF2PIN(5),
+    ZIF2PIN(6),
+    ZIF2PIN(7),
+    ZIF2PIN(8),
+
+    // 9-16
+    ZIF2PIN(9),
+    ZIF2PIN(10),
+    ZIF2PIN(11),
+    ZIF2PIN(12),
+    ZIF2PIN(13),
+    ZIF2PIN(14),
+    ZIF2PIN(15),
+    ZIF2PIN(16),
+
+    // 17-24
+    ZIF2PIN(17),
+    ZIF2PIN(18),
+    ZIF2PIN(19),
+    ZIF2PIN(20),
+    ZIF2PIN(21),
+    ZIF2PIN(22),
+    ZIF2PIN(23),
+    ZIF2PIN(24),
+
+    // 25-32
+    ZIF2PIN(25),
+    ZIF2PIN(26),
+    ZIF2PIN(27),
+    ZIF2PIN(28),
+    ZIF2PIN(29),
+    ZIF2PIN(30),
+    ZIF2PIN(31),
+    ZIF2PIN(32),
+
+    // 33-40
+    ZIF2PIN(33),
+    ZIF2PIN(34),
+    ZIF2PIN(35),
+    ZIF2PIN(36),
+    ZIF2PIN(37),
+    ZIF2PIN(38),
+    ZIF2PIN(39),
+    ZIF2PIN(40),
 };
 
 /* LE signal number is based off radioman schematic. They are scattered
@@ -224,20 +295,43 @@ const latch_info_t zif2gnd[40] = {
     {5, 4},  {5, 1},  {5, 7},  {5, 0},
 };
 
-static unsigned char
-    latch_mirror[8]; /* Read mirror of the current latch state. */
+/* Merge new ZIF bits into one I/O register and only write it if something
+ * changed. For LATx and TRISx the register reads back what was last written
+ * (not the pin level), so the register is its own shadow. Control pins that
+ * share the bank are written back with their current value and don't
+ * glitch. Nothing in the ISR touches these registers, so the read and write
+ * don't need to be atomic. */
+#define REG_MERGE(reg, mask, bits)                                             \
+    do {                                                                       \
+        unsigned char cur_ = (reg);                                            \
+        unsigned char next_ = (cur_ & ~(mask)) | (bits);                       \
+        if (next_ != cur_) {                                                   \
+            (reg) = next_;                                                     \
+        }                                                                      \
+    } while (0)
+
+/* Banks A, F and H have no ZIF pins and are never touched. */
+#define ZIF_REG_MERGE(zif, B, C, D, E, G, J)                                   \
+    do {                                                                       \
+        REG_MERGE(B, ZIF_MASK_B, zif_lut_z4_b[zif[4]]);                        \
+        REG_MERGE(C, ZIF_MASK_C, zif_lut_z0_c[zif[0]]);                        \
+        REG_MERGE(D, ZIF_MASK_D,                                               \
+                  zif_lut_z1_d[zif[1]] | zif_lut_z3_d[zif[3]]);                \
+        REG_MERGE(E, ZIF_MASK_E, zif_lut_z2_e[zif[2]]);                        \
+        REG_MERGE(G, ZIF_MASK_G,                                               \
+                  zif_lut_z1_g[zif[1]] | zif_lut_z3_g[zif[3]]);                \
+        REG_MERGE(J, ZIF_MASK_J,                                               \
+                  zif_lut_z0_j[zif[0]] | zif_lut_z1_j[zif[1]] |                \
+                      zif_lut_z3_j[zif[3]] | zif_lut_z4_j[zif[4]]);            \
+    } while (0)
 
 void dir_write(zif_bits_t zif_val)
 {
-    port_bits_t port_val = {0};
-
     DEBUG(print_zif_bits("  dir_write zif_bits", zif_val));
 
-    // Read control signals
-    dir_read_all(port_val);
-    zif_pins_to_ports(zif_val, port_val);
-    DEBUG(print_port_bits("  dir_write port_bits", port_val));
-    dir_write_all(port_val);
+    vid_settle_wait_driven();
+    ZIF_REG_MERGE(zif_val, TRISB, TRISC, TRISD, TRISE, TRISG, TRISJ);
+    TRACE_ZIF(TRACE_ZIF_DIR, trace_zif_tris, zif_val);
 }
 
 void dir_read(zif_bits_t zif_val)
@@ -252,28 +346,218 @@ void dir_read(zif_bits_t zif_val)
 
 void zif_write(zif_bits_t zif_val)
 {
-    port_bits_t port_val = {0};
+    PROF_START(t);
 
     DEBUG(print_zif_bits("  zif_write zif_bits", zif_val));
 
-    // Read control signals
-    port_read_all(port_val);
-    zif_pins_to_ports(zif_val, port_val);
-    DEBUG(print_port_bits("  zif_write port_bits", port_val));
-    port_write_all(port_val);
+    vid_settle_wait_driven();
+    ZIF_REG_MERGE(zif_val, LATB, LATC, LATD, LATE, LATG, LATJ);
+    TRACE_ZIF(TRACE_ZIF_WRITE, trace_zif_lat, zif_val);
+    PROF_END(PROF_ZIF_WRITE, t);
+}
+
+void zif_lat_read(zif_bits_t zif_val)
+{
+    port_bits_t port_val = {0};
+
+    port_val[OFFS_B] = LATB;
+    port_val[OFFS_C] = LATC;
+    port_val[OFFS_D] = LATD;
+    port_val[OFFS_E] = LATE;
+    port_val[OFFS_G] = LATG;
+    port_val[OFFS_J] = LATJ;
+    ports_to_zif_pins(port_val, zif_val);
 }
 
 void zif_read(zif_bits_t zif_val)
 {
     port_bits_t port_val = {0};
+    PROF_START(t);
 
     port_read_all(port_val);
     DEBUG(print_port_bits("  zif_read port_bits", port_val));
 
     ports_to_zif_pins(port_val, zif_val);
     DEBUG(print_zif_bits("  zif_read zif_bits", zif_val));
+    PROF_END(PROF_ZIF_READ, t);
+}
+
+const port_bits_t zif_port_mask = {0,          ZIF_MASK_B, ZIF_MASK_C,
+                                   ZIF_MASK_D, ZIF_MASK_E, 0,
+                                   ZIF_MASK_G, 0,          ZIF_MASK_J};
+
+volatile unsigned char *const port_regs[9] = {
+    &PORTA, &PORTB, &PORTC, &PORTD, &PORTE, &PORTF, &PORTG, &PORTH, &PORTJ};
+volatile unsigned char *const lat_regs[9] = {
+    &LATA, &LATB, &LATC, &LATD, &LATE, &LATF, &LATG, &LATH, &LATJ};
+volatile unsigned char *const tris_regs[9] = {
+    &TRISA, &TRISB, &TRISC, &TRISD, &TRISE, &TRISF, &TRISG, &TRISH, &TRISJ};
+
+int zif_bus_init(zif_bus_t *bus, const char *pins, unsigned len)
+{
+    zif_bus_seg_t *seg = NULL;
+
+    memset(bus, 0, sizeof(*bus));
+    if (len > ZIF_BUS_MAX) {
+        return -1;
+    }
+
+    for (unsigned char i = 0; i < len; i++) {
+        if (pins[i] < 1 || pins[i] > 40) {
+            return -1;
+        }
+        bus->pins[i] = pins[i] - 1;
+
+        port_info_t pi = zif2port[bus->pins[i]];
+        unsigned char mask = 1 << pi.offset;
+
+        // Extend the current run if this bit is the next one up on its port
+        if (seg && seg->bank == pi.bank &&
+            pi.offset == seg->shift + (i - seg->lsb)) {
+            seg->mask |= mask;
+        } else {
+            seg = &bus->segs[bus->nsegs++];
+            seg->bank = pi.bank;
+            seg->mask = mask;
+            seg->shift = pi.offset;
+            seg->lsb = i;
+        }
+
+        unsigned char b = 0;
+        while (b < bus->nbanks && bus->banks[b] != pi.bank) {
+            b++;
+        }
+        if (b == bus->nbanks) {
+            bus->banks[bus->nbanks++] = pi.bank;
+        }
+        bus->masks[b] |= mask;
+    }
+    bus->len = len;
+    return 0;
+}
+
+void zif_bus_dir(const zif_bus_t *bus, int tristate)
+{
+    vid_settle_wait_driven();
+    for (unsigned char b = 0; b < bus->nbanks; b++) {
+        REG_MERGE(*tris_regs[bus->banks[b]], bus->masks[b],
+                  tristate ? bus->masks[b] : 0x00);
+    }
+}
+
+void zif_bus_scatter(const zif_bus_t *bus, uint16_t val,
+                     unsigned char out[ZIF_BUS_BANKS])
+{
+    memset(out, 0, ZIF_BUS_BANKS);
+    for (unsigned char s = 0; s < bus->nsegs; s++) {
+        const zif_bus_seg_t *seg = &bus->segs[s];
+        unsigned char bits = (unsigned char)((val >> seg->lsb) << seg->shift);
+        unsigned char b = 0;
+
+        while (bus->banks[b] != seg->bank) {
+            b++;
+        }
+        out[b] |= bits & seg->mask;
+    }
+}
+
+void zif_bus_w(const zif_bus_t *bus, uint16_t val)
+{
+    unsigned char out[ZIF_BUS_BANKS];
+
+    vid_settle_wait_driven();
+
+    // Whole bus on one port run: a single shift
+    if (bus->nsegs == 1) {
+        const zif_bus_seg_t *seg = &bus->segs[0];
+        REG_MERGE(*lat_regs[seg->bank], seg->mask,
+                  (unsigned char)(val << seg->shift) & seg->mask);
+        return;
+    }
+
+    zif_bus_scatter(bus, val, out);
+    for (unsigned char b = 0; b < bus->nbanks; b++) {
+        REG_MERGE(*lat_regs[bus->banks[b]], bus->masks[b], out[b]);
+    }
+}
+
+void zif_bus_step(const zif_bus_t *bus, uint16_t from, uint16_t to)
+{
+    uint16_t diff = from ^ to;
+
+    vid_settle_wait_driven();
+    // Runs are in bus bit order, stop at the first one above every change
+    for (unsigned char s = 0; s < bus->nsegs; s++) {
+        const zif_bus_seg_t *seg = &bus->segs[s];
+        unsigned char mask;
+
+        if (!(diff >> seg->lsb)) {
+            break;
+        }
+        mask = (unsigned char)((diff >> seg->lsb) << seg->shift) & seg->mask;
+        if (mask) {
+            volatile unsigned char *lat = lat_regs[seg->bank];
+            unsigned char bits = (unsigned char)(to >> seg->lsb) << seg->shift;
+
+            *lat = (*lat & ~mask) | (bits & mask);
+        }
+    }
+}
+
+uint16_t zif_bus_r(const zif_bus_t *bus)
+{
+    port_bits_t snap;
+    uint16_t ret = 0;
+
+    if (bus->nsegs == 1) {
+        const zif_bus_seg_t *seg = &bus->segs[0];
+        return (*port_regs[seg->bank] & seg->mask) >> seg->shift;
+    }
+
+    // Sample every involved port back to back before decoding
+    for (unsigned char b = 0; b < bus->nbanks; b++) {
+        snap[bus->banks[b]] = *port_regs[bus->banks[b]];
+    }
+    for (unsigned char s = 0; s < bus->nsegs; s++) {
+        const zif_bus_seg_t *seg = &bus->segs[s];
+        ret |= (uint16_t)((snap[seg->bank] & seg->mask) >> seg->shift)
+               << seg->lsb;
+    }
+    return ret;
 }
 
+#ifndef IO_ZIF_BITLOOP
+/* Table driven translation, see zif_lut.h. Each ZIF byte only touches a few
+ * ports, so this is a handful of lookups instead of a 40 pass bit loop. */
+void zif_pins_to_ports(zif_bits_t zif, port_bits_t port)
+{
+    /* ZIF pins are shared w/ control pins. Don't accidentally erase control
+     * pin values. */
+    port[OFFS_B] = (port[OFFS_B] & ~ZIF_MASK_B) | zif_lut_z4_b[zif[4]];
+    port[OFFS_C] = (port[OFFS_C] & ~ZIF_MASK_C) | zif_lut_z0_c[zif[0]];
+    port[OFFS_D] = (port[OFFS_D] & ~ZIF_MASK_D) | zif_lut_z1_d[zif[1]] |
+                   zif_lut_z3_d[zif[3]];
+    port[OFFS_E] = (port[OFFS_E] & ~ZIF_MASK_E) | zif_lut_z2_e[zif[2]];
+    port[OFFS_G] = (port[OFFS_G] & ~ZIF_MASK_G) | zif_lut_z1_g[zif[1]] |
+                   zif_lut_z3_g[zif[3]];
+    port[OFFS_J] = (port[OFFS_J] & ~ZIF_MASK_J) | zif_lut_z0_j[zif[0]] |
+                   zif_lut_z1_j[zif[1]] | zif_lut_z3_j[zif[3]] |
+                   zif_lut_z4_j[zif[4]];
+}
+
+void ports_to_zif_pins(port_bits_t port, zif_bits_t zif)
+{
+    zif[0] = zif_lut_c_z0[port[OFFS_C]] | zif_lut_j_z0[port[OFFS_J]];
+    zif[1] = zif_lut_d_z1[port[OFFS_D]] | zif_lut_g_z1[port[OFFS_G]] |
+             zif_lut_j_z1[port[OFFS_J]];
+    zif[2] = zif_lut_e_z2[port[OFFS_E]];
+    zif[3] = zif_lut_d_z3[port[OFFS_D]] | zif_lut_g_z3[port[OFFS_G]] |
+             zif_lut_j_z3[port[OFFS_J]];
+    zif[4] = zif_lut_b_z4[port[OFFS_B]] | zif_lut_j_z4[port[OFFS_J]];
+}
+#else
+/* Original per-pin loops. Build with IO_ZIF_BITLOOP to compare cycle counts
+ * against the table driven version. */
 void zif_pins_to_ports(zif_bits_t zif, port_bits_t port)
 {
     for (unsigned int pin_no = 0;
@@ -307,6 +591,7 @@ void ports_to_zif_pins(port_bits_t port, zif_bits_t zif)
         zif[set_of_8] |= (pin_val << bit_offset);
     }
 }
+#endif
 
 /* Internal functions- we read/write all I/O ports at once. */
 void port_read_all(port_bits_t p_bits)
@@ -369,81 +654,78 @@ void zifdir_mask(unsigned char (*)[5])
 }
 */
 
+/* 74HC164 / 74HC373 timing minimums at the slowest (2V) datasheet column.
+ * Each C statement is already at least one instruction cycle (83ns), these
+ * only pad the difference. */
+#define HC164_TSU_NS 100 // SR_DAT setup before SR_CLK rising
+#define HC164_TW_NS  80  // SR_CLK pulse width
+#define HC164_TPD_NS 175 // SR_CLK to Q propagation
+#define HC373_TSU_NS 100 // D setup before LE falling
+#define HC373_TW_NS  80  // LE pulse width
+
+#define NS_TO_CYCLES(ns) (((ns) * (_XTAL_FREQ / 4000000UL) + 999) / 1000)
+#define HC_DELAY(ns)     _delay(NS_TO_CYCLES(ns))
+
+#define LE_PULSE(le)                                                           \
+    do {                                                                       \
+        le = 1;                                                                \
+        HC_DELAY(HC373_TW_NS > HC373_TSU_NS ? HC373_TW_NS : HC373_TSU_NS);     \
+        le = 0;                                                                \
+    } while (0)
+
 /* Write one of the 8 pin driver latches */
 void write_latch(int latch_no, unsigned char val)
 {
+    PROF_START(t);
+
     write_shreg(val);
+    // Let the last shift settle on the 74hc164 outputs
+    HC_DELAY(HC164_TPD_NS);
 
-    // 74hc373's setup time: 15ns hold time: 5ns
     // LE == 0 to preserve output, 1 is "transparent mode".
 
     switch (latch_no) {
     case 0:
-        LE0 = 1;
-        __delay_us(1);
-        LE0 = 0;
-        __delay_us(1);
+        LE_PULSE(LE0);
         break;
     case 1:
-        LE1 = 1;
-        __delay_us(1);
-        LE1 = 0;
-        __delay_us(1);
+        LE_PULSE(LE1);
         break;
     case 2:
-        LE2 = 1;
-        __delay_us(1);
-        LE2 = 0;
-        __delay_us(1);
+        LE_PULSE(LE2);
         break;
     case 3:
-        LE3 = 1;
-        __delay_us(1);
-        LE3 = 0;
-        __delay_us(1);
+        LE_PULSE(LE3);
         break;
     case 4:
-        LE4 = 1;
-        __delay_us(1);
-        LE4 = 0;
-        __delay_us(1);
+        LE_PULSE(LE4);
         break;
     case 5:
-        LE5 = 1;
-        __delay_us(1);
-        LE5 = 0;
-        __delay_us(1);
+        LE_PULSE(LE5);
         break;
     case 6:
-        LE6 = 1;
-        __delay_us(1);
-        LE6 = 0;
-        __delay_us(1);
+        LE_PULSE(LE6);
         break;
     case 7:
-        LE7 = 1;
-        __delay_us(1);
-        LE7 = 0;
-        __delay_us(1);
+        LE_PULSE(LE7);
         break;
     default:
         break;
     }
 
     latch_cache[latch_no] = val;
+    TRACE_EV(TRACE_LATCH + (latch_no & 7), val);
+    PROF_END(PROF_WRITE_LATCH, t);
 }
 
 /* Write the shift reg which connects to pin driver latches */
 void write_shreg(unsigned char in)
 {
-    for (int i = 0; i < 8; i++) {
-        unsigned char curr_bit = (in & 0x80) ? 1 : 0;
-
-        SR_DAT = curr_bit;
-        // 74hc164's data setup time: 20-100ns Hold time: 5ns
-        __delay_us(1);
+    for (unsigned char i = 0; i < 8; i++) {
+        SR_DAT = (in & 0x80) ? 1 : 0;
+        HC_DELAY(HC164_TSU_NS);
         SR_CLK = 1;
-        __delay_us(1);
+        HC_DELAY(HC164_TW_NS);
         SR_CLK = 0;
 
         in = in << 1;
@@ -456,14 +738,53 @@ void write_shreg(unsigned char in)
 
 } */
 
+/* VID changes need ~2ms for the regulators to settle. Rather than sleep
+ * in vpp_val() / vdd_val(), remember when the last change was made and let
+ * whatever next depends on the rails wait out the remainder. */
+#define VID_SETTLE_TICKS TIMER_US(2000)
+
+// 0xFF => unknown, forces the first write to settle
+static unsigned char vpp_vid = 0xFF;
+static unsigned char vdd_vid = 0xFF;
+static unsigned char vid_settling;
+static uint16_t vid_changed_at;
+
+static void vid_settle_start(void)
+{
+    vid_changed_at = timer_now();
+    vid_settling = 1;
+}
+
+void vid_settle_wait(void)
+{
+    if (vid_settling) {
+        PROF_START(t);
+
+        timer_wait_since(vid_changed_at, VID_SETTLE_TICKS);
+        vid_settling = 0;
+        PROF_END(PROF_VID_SETTLE, t);
+    }
+}
+
+// Pins only see the rails once an output is enabled
+static void vid_settle_wait_driven(void)
+{
+    if (vid_settling && !(nOE_VPP && nOE_VDD)) {
+        vid_settle_wait();
+    }
+}
+
 void vpp_en(void)
 {
+    vid_settle_wait();
     nOE_VPP = 0;
+    TRACE_EV(TRACE_VPP_EN, 0);
 }
 
 void vpp_dis(void)
 {
     nOE_VPP = 1;
+    TRACE_EV(TRACE_VPP_DIS, 0);
 }
 
 int vpp_state(void)
@@ -473,12 +794,15 @@ int vpp_state(void)
 
 void vdd_en(void)
 {
+    vid_settle_wait();
     nOE_VDD = 0;
+    TRACE_EV(TRACE_VDD_EN, 0);
 }
 
 void vdd_dis(void)
 {
     nOE_VDD = 1;
+    TRACE_EV(TRACE_VDD_DIS, 0);
 }
 
 int vdd_state(void)
@@ -492,111 +816,189 @@ int OEn_state(void)
            (LE2 << 2) | (LE1 << 1) | (LE0 << 0);
 }
 
-void set_vpp(const_zif_bits_t zif)
+/* Latches 0-1 drive VPP, 2-4 VDD and 5-7 GND. The VDD drivers are PNPs, so
+ * a logic 0 enables the VDD line for an I/O pin. */
+#define LATCH_VPP 0
+#define LATCH_VDD 2
+#define LATCH_GND 5
+
+static unsigned char latch_on_bits(unsigned char latch_no, unsigned char val)
 {
-    unsigned char latch_vpp_masks[2] = {0};
+    return (latch_no >= LATCH_VDD && latch_no < LATCH_GND) ? ~val : val;
+}
 
-    for (unsigned int pin_no = 0;
-         pin_no < (sizeof(zif2vpp) / sizeof(latch_info_t)); pin_no++) {
-        latch_info_t curr = zif2vpp[pin_no];
+/* OR the given ZIF pins into latch values, starting at latch `first`.
+ * Pins that can't be connected (offset == -1 or less) are skipped. */
+static void zif_to_latch_on(const_zif_bits_t zif, const latch_info_t *map,
+                            unsigned char first, unsigned char *on)
+{
+    for (unsigned char pin_no = 0; pin_no < 40; pin_no++) {
+        latch_info_t curr = map[pin_no];
 
-        // Commands are zif-based; don't bother assigning a voltage to a zif
-        // pin which doesn't have any (offset == -1 or less).
         if (curr.offset < 0) {
             continue;
-        } else {
-            unsigned char set_of_8 = (pin_no >> 3);
-            unsigned char bit_offset = 1 << (pin_no & 0x07);
-
-            unsigned char mask = (zif[set_of_8] & bit_offset) ? 1 : 0;
-
-            latch_vpp_masks[curr.number] |=
-                (mask << (unsigned char)curr.offset);
+        }
+        if (zif[pin_no >> 3] & (1 << (pin_no & 0x07))) {
+            on[curr.number - first] |= 1 << (unsigned char)curr.offset;
         }
     }
+}
 
-    write_latch(0, latch_vpp_masks[0]);
-    write_latch(1, latch_vpp_masks[1]);
+static void latch_update(unsigned char latch_no, unsigned char val)
+{
+    if (latch_cache[latch_no] != val) {
+        write_latch(latch_no, val);
+    }
 }
 
-void set_vdd(const_zif_bits_t zif)
+/* Move the pin drivers to `target`, shifting only latches that change.
+ * Connections that go away are broken first, then new ones are made, so a
+ * pin moving from one rail to another is never connected to both. */
+static void latch_commit(latch_bits_t target, unsigned char gnd20)
 {
-    unsigned char latch_vdd_masks[3] = {0};
+    // Break: keep only connections present both now and in the target
+    for (unsigned char i = 0; i < 8; i++) {
+        unsigned char keep = latch_on_bits(i, latch_cache[i]) &
+                             latch_on_bits(i, target[i]);
+        latch_update(i, latch_on_bits(i, keep));
+    }
+    if (!gnd20) {
+        GND20 = 0;
+    }
 
-    for (unsigned int pin_no = 0;
-         pin_no < (sizeof(zif2vdd) / sizeof(latch_info_t)); pin_no++) {
-        latch_info_t curr = zif2vdd[pin_no];
+    // Make
+    for (unsigned char i = 0; i < 8; i++) {
+        latch_update(i, target[i]);
+    }
+    // GND_20 is special; it is controlled directly via GPIO rather than
+    // through a latch.
+    GND20 = gnd20;
+}
 
-        if (curr.offset < 0) {
-            continue;
-        } else {
-            unsigned char set_of_8 = (pin_no >> 3);
-            unsigned char bit_offset = 1 << (pin_no & 0x07);
+static unsigned char zif_gnd20(const_zif_bits_t zif)
+{
+    return (zif[19 >> 3] & (1 << (19 & 0x07))) ? 1 : 0;
+}
 
-            // Drivers are PNPs, so a logic 0 enables Vdd line for I/O pin.
-            unsigned char mask = (zif[set_of_8] & bit_offset) ? 1 : 0;
+void power_plan_apply(const power_plan_t *plan)
+{
+    latch_bits_t target;
+    unsigned char on[3] = {0};
+
+    zif_to_latch_on(plan->vpp, zif2vpp, LATCH_VPP, on);
+    target[0] = on[0];
+    target[1] = on[1];
+
+    on[0] = on[1] = 0;
+    zif_to_latch_on(plan->vdd, zif2vdd, LATCH_VDD, on);
+    target[2] = ~on[0];
+    target[3] = ~on[1];
+    target[4] = ~on[2];
+
+    on[0] = on[1] = on[2] = 0;
+    zif_to_latch_on(plan->gnd, zif2gnd, LATCH_GND, on);
+    target[5] = on[0];
+    target[6] = on[1];
+    target[7] = on[2];
+
+    latch_commit(target, zif_gnd20(plan->gnd));
+}
 
-            latch_vdd_masks[curr.number - 2] |=
-                (mask << (unsigned char)curr.offset);
+static void latch_map_caps(const latch_info_t *map, zif_bits_t caps)
+{
+    for (unsigned char pin_no = 0; pin_no < 40; pin_no++) {
+        if (map[pin_no].offset >= 0) {
+            caps[pin_no >> 3] |= 1 << (pin_no & 0x07);
         }
     }
-
-    write_latch(2, ~latch_vdd_masks[0]);
-    write_latch(3, ~latch_vdd_masks[1]);
-    write_latch(4, ~latch_vdd_masks[2]);
 }
 
-void set_gnd(const_zif_bits_t zif)
+void power_caps(power_plan_t *caps)
 {
-    unsigned char latch_gnd_masks[3] = {0};
-
-    for (unsigned int pin_no = 0;
-         pin_no < (sizeof(zif2gnd) / sizeof(latch_info_t)); pin_no++) {
-        latch_info_t curr = zif2gnd[pin_no];
-
-        if (curr.offset < 0) {
-            continue;
-        } else {
-            unsigned char set_of_8 = (pin_no >> 3);
-            unsigned char bit_offset = 1 << (pin_no & 0x07);
-
-            // Drivers are PNPs, so a logic 0 enables Vdd line for I/O pin.
-            unsigned char mask = (zif[set_of_8] & bit_offset) ? 1 : 0;
+    memset(caps, 0, sizeof(*caps));
+    latch_map_caps(zif2vpp, caps->vpp);
+    latch_map_caps(zif2vdd, caps->vdd);
+    latch_map_caps(zif2gnd, caps->gnd);
+    // GND20 GPIO
+    caps->gnd[19 >> 3] |= 1 << (19 & 0x07);
+}
 
-            latch_gnd_masks[curr.number - 5] |=
-                (mask << (unsigned char)curr.offset);
-        }
-    }
+void set_vpp(const_zif_bits_t zif)
+{
+    latch_bits_t target;
+    unsigned char on[2] = {0};
+
+    memcpy(target, latch_cache, sizeof(target));
+    zif_to_latch_on(zif, zif2vpp, LATCH_VPP, on);
+    target[0] = on[0];
+    target[1] = on[1];
+    latch_commit(target, GND20);
+}
 
-    write_latch(5, latch_gnd_masks[0]);
-    write_latch(6, latch_gnd_masks[1]);
-    write_latch(7, latch_gnd_masks[2]);
+void set_vdd(const_zif_bits_t zif)
+{
+    latch_bits_t target;
+    unsigned char on[3] = {0};
+
+    memcpy(target, latch_cache, sizeof(target));
+    zif_to_latch_on(zif, zif2vdd, LATCH_VDD, on);
+    target[2] = ~on[0];
+    target[3] = ~on[1];
+    target[4] = ~on[2];
+    latch_commit(target, GND20);
+}
 
-    // GND_20 is special; it is controlled directly via GPIO rather than
-    // through a latch.
-    unsigned char pin_no = 19;
-    unsigned char set_of_8 = (pin_no >> 3);
-    unsigned char bit_offset = 1 << (pin_no & 0x07);
-    unsigned char gnd_20_en = (zif[set_of_8] & bit_offset) ? 1 : 0;
-    GND20 = gnd_20_en;
+void set_gnd(const_zif_bits_t zif)
+{
+    latch_bits_t target;
+    unsigned char on[3] = {0};
+
+    memcpy(target, latch_cache, sizeof(target));
+    zif_to_latch_on(zif, zif2gnd, LATCH_GND, on);
+    target[5] = on[0];
+    target[6] = on[1];
+    target[7] = on[2];
+    latch_commit(target, zif_gnd20(zif));
 }
 
 void vpp_val(unsigned char setting)
 {
+    PROF_START(t);
+
+    setting &= 0x07;
+    if (setting == vpp_vid) {
+        PROF_END(PROF_VPP_VAL, t);
+        return;
+    }
+    vpp_vid = setting;
+
     VID_10 = (setting & 0x01) ? 1 : 0;
     VID_11 = (setting & 0x02) ? 1 : 0;
     VID_12 = (setting & 0x04) ? 1 : 0;
 
-    __delay_ms(2);
+    vid_settle_start();
+    TRACE_EV(TRACE_VPP_VAL, setting);
+    PROF_END(PROF_VPP_VAL, t);
 }
 
 void vdd_val(unsigned char setting)
 {
+    PROF_START(t);
+
+    setting &= 0x07;
+    if (setting == vdd_vid) {
+        PROF_END(PROF_VDD_VAL, t);
+        return;
+    }
+    vdd_vid = setting;
+
     VID_00 = (setting & 0x01) ? 1 : 0;
     VID_01 = (setting & 0x02) ? 1 : 0;
     VID_02 = (setting & 0x04) ? 1 : 0;
 
-    __delay_ms(2);
+    vid_settle_start();
+    TRACE_EV(TRACE_VDD_VAL, setting);
+    PROF_END(PROF_VDD_VAL, t);
 }
 
 void pupd(int tristate, int val)
@@ -635,15 +1037,14 @@ void print_latch_bits(const char *prefix, latch_bits_t lb)
 void io_init(void)
 {
     zif_bits_t zif_val = {0, 0, 0, 0, 0};
+    power_plan_t plan = {0};
 
     // Idle power supplies
     vpp_dis();
     vdd_dis();
     vpp_val(0);
     vdd_val(0);
-    set_vpp(zif_val);
-    set_vdd(zif_val);
-    set_gnd(zif_val);
+    power_plan_apply(&plan);
 
     // Set default values
     // LED?
@@ -8,6 +8,7 @@
 #ifndef IO_H
 #define IO_H
 
+#include <stdint.h>
 #include <xc.h>
 
 #ifdef __cplusplus
@@ -34,6 +35,23 @@ typedef struct port_info {
     unsigned char offset;
 } port_info_t;
 
+/// One ZIF pin as a port_bits_t index and bit mask.
+typedef struct port_pin {
+    unsigned char bank;
+    unsigned char mask;
+} port_pin_t;
+
+/// Port location of each ZIF pin, index 0 is pin 1.
+extern const port_pin_t zif2pin[40];
+
+/// ZIF socket bits of each port, by port_bits_t index.
+extern const port_bits_t zif_port_mask;
+
+/// PORTx / LATx / TRISx by port_bits_t index, for use with port_pin_t.
+extern volatile unsigned char *const port_regs[9];
+extern volatile unsigned char *const lat_regs[9];
+extern volatile unsigned char *const tris_regs[9];
+
 typedef struct latch_info {
     unsigned char number; /* Translates to LE signal write within case statement
                              in write_latch() */
@@ -44,27 +62,29 @@ typedef struct latch_info {
 #define PORT_ADDR_TO_ARRAY_INDEX(_x)
 
 // Static pin defines (uses radioman's identifiers)
-#define SR_CLK PORTHbits.RH3
-#define SR_DAT PORTHbits.RH2
-
-#define nOE_VPP PORTGbits.RG4
-#define nOE_VDD PORTAbits.RA4
-
-#define LE0 PORTHbits.RH0
-#define LE1 PORTHbits.RH1
-#define LE2 PORTAbits.RA2
-#define LE3 PORTAbits.RA0
-#define LE4 PORTAbits.RA5
-#define LE5 PORTAbits.RA3
-#define LE6 PORTHbits.RH4
-#define LE7 PORTAbits.RA1
-
-#define VID_00 PORTFbits.RF5
-#define VID_01 PORTFbits.RF6
-#define VID_02 PORTFbits.RF7
-#define VID_10 PORTHbits.RH6
-#define VID_11 PORTHbits.RH7
-#define VID_12 PORTFbits.RF2
+// Outputs go through LATx so setting one never latches the pin levels of
+// the other bits in the bank (PORTx bit ops are read-modify-write on pins)
+#define SR_CLK LATHbits.LATH3
+#define SR_DAT LATHbits.LATH2
+
+#define nOE_VPP LATGbits.LATG4
+#define nOE_VDD LATAbits.LATA4
+
+#define LE0 LATHbits.LATH0
+#define LE1 LATHbits.LATH1
+#define LE2 LATAbits.LATA2
+#define LE3 LATAbits.LATA0
+#define LE4 LATAbits.LATA5
+#define LE5 LATAbits.LATA3
+#define LE6 LATHbits.LATH4
+#define LE7 LATAbits.LATA1
+
+#define VID_00 LATFbits.LATF5
+#define VID_01 LATFbits.LATF6
+#define VID_02 LATFbits.LATF7
+#define VID_10 LATHbits.LATH6
+#define VID_11 LATHbits.LATH7
+#define VID_12 LATFbits.LATF2
 
 #define VID_00_TRIS TRISFbits.TRISF5
 #define VID_01_TRIS TRISFbits.TRISF6
@@ -73,10 +93,10 @@ typedef struct latch_info {
 #define VID_11_TRIS TRISHbits.TRISH7
 #define VID_12_TRIS TRISFbits.TRISF2
 
-#define GND20 PORTCbits.RC1
+#define GND20 LATCbits.LATC1
 #define OVC   PORTBbits.RB0
 
-#define LED PORTCbits.RC0
+#define LED LATCbits.LATC0
 
 /*
 Connects to resistors on P1, P2, P3, P4, P7, P8, P11, P12, P16, P30
@@ -99,11 +119,67 @@ void dir_write(zif_bits_t zif_val);
 void dir_read(zif_bits_t zif_val);
 
 /// Writes all ZIF pins whose directions are set for write.
+/// Only banks whose ZIF bits change are written, and non-ZIF control pins
+/// sharing those banks keep their latched value.
 void zif_write(zif_bits_t zif_val);
 
 /// Reads all ZIF pins.
 void zif_read(zif_bits_t zif_val);
 
+/// Reads back the ZIF pin output values last written (LATx).
+void zif_lat_read(zif_bits_t zif_val);
+
+#define ZIF_BUS_MAX   16
+#define ZIF_BUS_BANKS 6 /* B C D E G J */
+
+/// Runs of consecutive bus bits that sit on consecutive bits of one port.
+typedef struct zif_bus_seg {
+    unsigned char bank;  /* port_bits_t index */
+    unsigned char mask;  /* port bits covered */
+    unsigned char shift; /* port bit of the run's lowest bus bit */
+    unsigned char lsb;   /* bus bit of the run's lowest bit */
+} zif_bus_seg_t;
+
+/// A group of ZIF pins compiled once into per-port masks, so that a bus
+/// write is one read-modify-write per port and a bus read is one gather
+/// from a single port snapshot. Bit i of a bus value is pins[i].
+typedef struct zif_bus {
+    unsigned char len;
+    unsigned char pins[ZIF_BUS_MAX]; /* 0 based ZIF pin of each bus bit */
+    unsigned char nsegs;
+    zif_bus_seg_t segs[ZIF_BUS_MAX];
+    unsigned char nbanks;
+    unsigned char banks[ZIF_BUS_BANKS]; /* port_bits_t index */
+    unsigned char masks[ZIF_BUS_BANKS]; /* bus bits in that port */
+} zif_bus_t;
+
+/// Builds `bus` from `len` 1 based ZIF pin numbers, LSB first.
+/// Returns 0 on success, -1 on a bad pin or length.
+int zif_bus_init(zif_bus_t *bus, const char *pins, unsigned len);
+
+/// Sets the direction of all bus pins, see dir_write().
+void zif_bus_dir(const zif_bus_t *bus, int tristate);
+
+/// Splits `val` into per-port bits, out[i] is for port bus->banks[i].
+void zif_bus_scatter(const zif_bus_t *bus, uint16_t val,
+                     unsigned char out[ZIF_BUS_BANKS]);
+
+/// Writes `val` to the bus pins. Other pins are left alone.
+void zif_bus_w(const zif_bus_t *bus, uint16_t val);
+
+/// Moves the bus from `from` (the value last written) to `to`, touching
+/// only the ports holding bits that differ. For a sequential sweep most
+/// steps are a single write to the port with the low address bits.
+void zif_bus_step(const zif_bus_t *bus, uint16_t from, uint16_t to);
+
+/// Gray code of i. Walking i = 0, 1, 2... visits every address of a power
+/// of two range while changing one bus bit per step, for targets that can
+/// be read in any order.
+#define ZIF_GRAY(i) ((i) ^ ((i) >> 1))
+
+/// Reads the bus pins.
+uint16_t zif_bus_r(const zif_bus_t *bus);
+
 void write_latch(int latch_no, unsigned char val);
 void write_shreg(unsigned char in);
 
@@ -122,9 +198,15 @@ void write_shreg(unsigned char in);
 #define VPP_212 7
 
 /// Sets the voltage level for VPP. Only the least significant 3 bits are used.
-/// The default setting is 0.
+/// The default setting is 0. Returns immediately; the rail settles in the
+/// background (see vid_settle_wait()).
 void vpp_val(unsigned char setting);
 
+/// Waits out any remaining settling time from the last vpp_val() /
+/// vdd_val() change. vpp_en(), vdd_en() and pin writes with a rail enabled
+/// already do this.
+void vid_settle_wait(void);
+
 /// Sets the given ZIF pins to output VPP. Pins that cannot support
 /// VPP are ignored. VPP is not output until vpp_en() is called.
 /// By default, no pins are assigned to VPP.
@@ -154,7 +236,7 @@ int vpp_state(void);
 #define VDD_65 7
 
 /// Sets the voltage level for VDD. Only the least significant 3 bits are used.
-/// The default setting is 0.
+/// The default setting is 0. Returns immediately, like vpp_val().
 void vdd_val(unsigned char setting);
 
 /// Sets the given ZIF pins to output VDD. Pins that cannot support
@@ -177,6 +259,22 @@ int vdd_state(void);
 /// By default, no pins are assigned to GND.
 void set_gnd(const_zif_bits_t zif);
 
+/// Complete VPP / VDD / GND pin assignment.
+typedef struct power_plan {
+    zif_bits_t vpp;
+    zif_bits_t vdd;
+    zif_bits_t gnd;
+} power_plan_t;
+
+/// Applies all three rail assignments in one pass. Only latches whose value
+/// changes are shifted out. Connections that are dropped are broken before
+/// new ones are made, so a pin is never tied to two rails at once.
+/// set_vpp(), set_vdd() and set_gnd() are the single rail equivalents.
+void power_plan_apply(const power_plan_t *plan);
+
+/// Fills `caps` with the pins each rail can physically reach.
+void power_caps(power_plan_t *caps);
+
 /// Sets the state of the pull resistors. If `tristate` is 1,
 /// then the pull resistors are disabled and `val` is ignored.
 /// If `tristate` is 0 then setting `val` to 0 connects the
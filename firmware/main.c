@@ -12,6 +12,7 @@
 #include "io.h"
 #include "mode.h"
 #include "stock_compat.h"
+#include "timer.h"
 
 static inline void init(void)
 {
@@ -65,6 +66,8 @@ static inline void init(void)
     PORTJ = 0x00; // All attached to ZIF
     TRISJ = 0x00;
 
+    timer_init();
+
     // Disable all pin drivers for initial "known" state.
     vpp_dis();
     vdd_dis();
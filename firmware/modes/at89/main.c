@@ -3,8 +3,11 @@
 #include "../../arglib.h"
 #include "../../at89.h"
 #include "../../comlib.h"
+#include "../../prof.h"
 #include "../../stock_compat.h"
 #include "../../system.h"
+#include "../../timer.h"
+#include "../../trace.h"
 
 int checking_sig = 1;
 
@@ -20,30 +23,49 @@ static inline void print_help(void)
     com_println("S en           Enable signature check");
     com_println("B              Blank check");
     com_println("T              Run some tests");
+    com_println("U              Print and reset USB statistics");
+#ifdef PROF
+    com_println("K              Dump and reset profiling counters");
+#endif
+#ifdef TRACE
+    com_println("Y              Dump and clear the event trace");
+#endif
     com_println("h              Print help");
     com_println("L val          LED on/off");
     com_println("b              reset to bootloader");
     com_println("addr, range in hex");
 }
 
+static uint8_t read_source(void *ctx, uint16_t idx)
+{
+    com_progress(idx, 0);
+    return at89_read_next(*(unsigned int *)ctx + idx);
+}
+
 static void print_read(unsigned int addr, unsigned int range)
 {
-    printf("%03X", addr);
+    com_print_hex(addr, 3);
+
+    com_progress_begin('r', range);
+    at89_read_begin(addr);
+    com_stream_hex(range, read_source, &addr);
+    at89_read_end();
+    com_progress(range, 0);
+    com_progress_end();
+    com_println("");
+}
 
-    for (unsigned int byte_idx = 0; byte_idx < range; byte_idx++) {
-        printf(" %02X", at89_read(addr + byte_idx));
-    }
-    printf("\r\n");
+static uint8_t sysflash_source(void *ctx, uint16_t idx)
+{
+    return at89_read_sysflash(*(unsigned int *)ctx + idx);
 }
 
 static void print_sysflash(unsigned int addr, unsigned int range)
 {
-    printf("%03X ", addr);
-
-    for (unsigned int byte_idx = 0; byte_idx < range; byte_idx++) {
-        printf(" %02X", at89_read_sysflash(addr + byte_idx));
-    }
-    printf("\r\n");
+    com_print_hex(addr, 3);
+    com_print(" ");
+    com_stream_hex(range, sysflash_source, &addr);
+    com_println("");
 }
 
 static bool sig_check()
@@ -69,23 +91,44 @@ static bool sig_check()
     return false;
 }
 
-static bool blank_check()
+// Returns the first address not 0xFF and its byte, 0x1000 if blank.
+// Progress goes out as EP1 notifications, not in the text stream
+static unsigned int blank_scan(unsigned char *data)
 {
-    // Update address in place by using backspace
-    printf("Performing a blank-check... ");
-    unsigned char data = 0;
-    for (unsigned int addr = 0; addr < 0xFFF; addr++) {
-        printf("%03X", addr);
-        data = at89_read(addr);
-        printf("\b\b\b");
-        if (data != 0xFF) {
-            printf("done\r\n");
-            printf("%03X set to byte %02X\r\n", addr, data);
-            printf("Result: not blank\r\n");
-            return false;
+    com_progress_begin('B', 0x1000);
+    // Order doesn't matter: Gray order moves one address pin per read
+    at89_read_begin(0);
+    for (unsigned int i = 0; i <= 0xFFF; i++) {
+        unsigned int addr = ZIF_GRAY(i);
+
+        com_progress(i, 0);
+        *data = at89_read_next(addr);
+        if (*data != 0xFF) {
+            com_progress(i, 1);
+            com_progress_end();
+            at89_read_end();
+            return addr;
         }
     }
+    com_progress(0x1000, 0);
+    com_progress_end();
+    at89_read_end();
+    return 0x1000;
+}
+
+static bool blank_check()
+{
+    unsigned char data;
+    unsigned int addr;
+
+    printf("Performing a blank-check... ");
+    addr = blank_scan(&data);
     printf("done\r\n");
+    if (addr != 0x1000) {
+        printf("%03X set to byte %02X\r\n", addr, data);
+        printf("Result: not blank\r\n");
+        return false;
+    }
     printf("Result: blank\r\n");
     return true;
 }
@@ -210,6 +253,22 @@ static inline void eval_command(char *cmd)
         blank_check();
         break;
 
+    case 'U':
+        com_stats_print();
+        break;
+
+#ifdef PROF
+    case 'K':
+        prof_dump();
+        break;
+#endif
+
+#ifdef TRACE
+    case 'Y':
+        trace_dump();
+        break;
+#endif
+
     case '?':
     case 'h':
         print_help();
@@ -233,9 +292,138 @@ static inline void eval_command(char *cmd)
     }
 }
 
+/*
+Binary ops, same letters as the text commands
+r: addr (u16), range (u16) => data
+w: addr (u16), data
+W: addr (u16), len (u16) => window (u16), then a len byte write stream
+e: erase
+B: => first address not 0xFF (u16), 0x1000 if blank
+r, W and B post progress notifications
+*/
+
+static void frame_read(const uint8_t *req, uint16_t len)
+{
+    unsigned int addr;
+    unsigned int range;
+
+    if (len != 4) {
+        com_frame_reply(COM_FRAME_E_ARG, 0);
+        return;
+    }
+    if (!sig_check()) {
+        com_frame_reply(COM_FRAME_E_CMD, 0);
+        return;
+    }
+    addr = COM_U16(req);
+    range = COM_U16(req + 2);
+
+    com_frame_reply(COM_FRAME_OK, range);
+    com_progress_begin('r', range);
+    at89_read_begin(addr);
+    for (unsigned int i = 0; i < range; i++) {
+        com_progress(i, 0);
+        com_frame_put(at89_read_next(addr + i));
+    }
+    at89_read_end();
+    com_progress(range, 0);
+    com_progress_end();
+}
+
+static void frame_write(const uint8_t *req, uint16_t len)
+{
+    if (len != 3) {
+        com_frame_reply(COM_FRAME_E_ARG, 0);
+        return;
+    }
+    if (!sig_check()) {
+        com_frame_reply(COM_FRAME_E_CMD, 0);
+        return;
+    }
+    at89_write(COM_U16(req), req[2]);
+}
+
+struct write_stream {
+    unsigned int addr;
+    unsigned int len;
+};
+
+static bool write_sink(void *ctx, uint16_t off, const uint8_t *buf,
+                       uint16_t len)
+{
+    struct write_stream *ws = ctx;
+
+    for (uint16_t i = 0; i < len; i++) {
+        at89_write(ws->addr + off + i, buf[i]);
+        com_progress(off + i + 1, 0);
+    }
+    if (off + len == ws->len) {
+        com_progress_end();
+    }
+    return true;
+}
+
+static void frame_write_stream(const uint8_t *req, uint16_t len)
+{
+    static struct write_stream ws;
+    uint16_t window;
+
+    if (len != 4 || COM_U16(req) > 0x1000 ||
+        COM_U16(req + 2) > 0x1000 - COM_U16(req)) {
+        com_frame_reply(COM_FRAME_E_ARG, 0);
+        return;
+    }
+    if (!sig_check()) {
+        com_frame_reply(COM_FRAME_E_CMD, 0);
+        return;
+    }
+    ws.addr = COM_U16(req);
+    ws.len = COM_U16(req + 2);
+    if (ws.len) {
+        com_progress_begin('W', ws.len);
+    }
+    window = com_wr_begin(ws.len, write_sink, &ws);
+    com_frame_reply(COM_FRAME_OK, 2);
+    com_frame_put(window & 0xFF);
+    com_frame_put(window >> 8);
+}
+
+static void frame_erase(const uint8_t *req, uint16_t len)
+{
+    if (!sig_check()) {
+        com_frame_reply(COM_FRAME_E_CMD, 0);
+        return;
+    }
+    at89_erase();
+}
+
+static void frame_blank(const uint8_t *req, uint16_t len)
+{
+    unsigned char data;
+    unsigned int addr;
+
+    if (!sig_check()) {
+        com_frame_reply(COM_FRAME_E_CMD, 0);
+        return;
+    }
+    addr = blank_scan(&data);
+    com_frame_reply(COM_FRAME_OK, 2);
+    com_frame_put(addr & 0xFF);
+    com_frame_put(addr >> 8);
+}
+
+static const com_frame_op_t frame_ops[] = {
+    {'r', frame_read},
+    {'w', frame_write},
+    {'W', frame_write_stream},
+    {'e', frame_erase},
+    {'B', frame_blank},
+};
+
 void mode_main(void)
 {
     vpp_dis();
+    com_frame_ops(frame_ops, sizeof(frame_ops) / sizeof(frame_ops[0]));
 
     while (1) {
         eval_command(com_cmd_prompt());
@@ -245,4 +433,5 @@ void mode_main(void)
 void interrupt high_priority isr()
 {
     usb_service();
+    timer_service();
 }
@@ -9,7 +9,11 @@
 #include "../../comlib.h"
 #include "../../io.h"
 #include "../../mode.h"
+#include "../../pinvm.h"
+#include "../../prof.h"
 #include "../../stock_compat.h"
+#include "../../timer.h"
+#include "../../trace.h"
 
 static inline void print_help(void)
 {
@@ -45,12 +49,23 @@ static inline void print_help(void)
                 "           LSB is ZIF pin 1\r\n"
                 "Z          I/O: get ZIF pins (ZIF_READ)\r\n"
                 "           LSB is ZIF pin 1\r\n"
+                "Pin program\r\n"
+                "x off hex  Load program bytes at offset\r\n"
+                "           off 0 starts a new program\r\n"
+                "X          Run program, reads print as hex lines\r\n"
                 "Misc\r\n"
                 "L val      LED on/off\r\n"
                 "           1 = on, 0 = off\r\n"
                 "m z val    Set pullup/pulldown\r\n"
                 "s          Print misc status\r\n"
                 "i          Re-initialize\r\n"
+                "U          Print and reset USB statistics\r\n"
+#ifdef PROF
+                "K          Dump and reset profiling counters\r\n"
+#endif
+#ifdef TRACE
+                "Y          Dump and clear the event trace\r\n"
+#endif
                 "b          Reset to bootloader\r\n");
 }
 
@@ -199,6 +214,33 @@ static inline void eval_command(char *cmd)
         break;
     }
 
+    /*
+    Pin program
+    */
+
+    // Load program chunk
+    case 'x': {
+        unsigned char buf[PINVM_CHUNK_MAX];
+        int len;
+
+        if (!arg_i()) {
+            break;
+        }
+        len = arg_hex(buf, sizeof(buf));
+        if (len < 0) {
+            break;
+        }
+        if (last_i < 0 || pinvm_load(last_i, buf, len)) {
+            printf("ERROR: program too large\r\n");
+        }
+        break;
+    }
+
+    // Run program
+    case 'X':
+        pinvm_run();
+        break;
+
     /*
     Misc
     */
@@ -233,6 +275,22 @@ static inline void eval_command(char *cmd)
         io_init();
         break;
 
+    case 'U':
+        com_stats_print();
+        break;
+
+#ifdef PROF
+    case 'K':
+        prof_dump();
+        break;
+#endif
+
+#ifdef TRACE
+    case 'Y':
+        trace_dump();
+        break;
+#endif
+
     // Help
     case '?':
     case 'h':
@@ -251,8 +309,120 @@ static inline void eval_command(char *cmd)
     }
 }
 
+/*
+Binary ops, same letters as the text commands
+ZIF values are 5 bytes, LSB of the first byte is ZIF pin 1
+*/
+
+static bool frame_arg(uint16_t len, uint16_t want)
+{
+    if (len != want) {
+        com_frame_reply(COM_FRAME_E_ARG, 0);
+        return false;
+    }
+    return true;
+}
+
+static void frame_vpp_en(const uint8_t *req, uint16_t len)
+{
+    if (frame_arg(len, 1)) {
+        if (req[0]) {
+            vpp_en();
+        } else {
+            vpp_dis();
+        }
+    }
+}
+
+static void frame_vpp_val(const uint8_t *req, uint16_t len)
+{
+    if (frame_arg(len, 1)) {
+        vpp_val(req[0]);
+    }
+}
+
+static void frame_vpp_pins(const uint8_t *req, uint16_t len)
+{
+    if (frame_arg(len, sizeof(zif_bits_t))) {
+        set_vpp(req);
+    }
+}
+
+static void frame_vdd_en(const uint8_t *req, uint16_t len)
+{
+    if (frame_arg(len, 1)) {
+        if (req[0]) {
+            vdd_en();
+        } else {
+            vdd_dis();
+        }
+    }
+}
+
+static void frame_vdd_val(const uint8_t *req, uint16_t len)
+{
+    if (frame_arg(len, 1)) {
+        vdd_val(req[0]);
+    }
+}
+
+static void frame_vdd_pins(const uint8_t *req, uint16_t len)
+{
+    if (frame_arg(len, sizeof(zif_bits_t))) {
+        set_vdd(req);
+    }
+}
+
+static void frame_gnd_pins(const uint8_t *req, uint16_t len)
+{
+    if (frame_arg(len, sizeof(zif_bits_t))) {
+        set_gnd(req);
+    }
+}
+
+static void frame_dir_write(const uint8_t *req, uint16_t len)
+{
+    if (frame_arg(len, sizeof(zif_bits_t))) {
+        dir_write((unsigned char *)req);
+    }
+}
+
+static void frame_dir_read(const uint8_t *req, uint16_t len)
+{
+    zif_bits_t zif;
+
+    dir_read(zif);
+    com_frame_reply(COM_FRAME_OK, sizeof(zif));
+    com_frame_write(zif, sizeof(zif));
+}
+
+static void frame_zif_write(const uint8_t *req, uint16_t len)
+{
+    if (frame_arg(len, sizeof(zif_bits_t))) {
+        zif_write((unsigned char *)req);
+    }
+}
+
+static void frame_zif_read(const uint8_t *req, uint16_t len)
+{
+    zif_bits_t zif;
+
+    zif_read(zif);
+    com_frame_reply(COM_FRAME_OK, sizeof(zif));
+    com_frame_write(zif, sizeof(zif));
+}
+
+static const com_frame_op_t frame_ops[] = {
+    {'E', frame_vpp_en},   {'V', frame_vpp_val},    {'p', frame_vpp_pins},
+    {'e', frame_vdd_en},   {'v', frame_vdd_val},    {'d', frame_vdd_pins},
+    {'g', frame_gnd_pins}, {'t', frame_dir_write},  {'T', frame_dir_read},
+    {'z', frame_zif_write}, {'Z', frame_zif_read},
+};
+
 void mode_main(void)
 {
+    com_frame_ops(frame_ops, sizeof(frame_ops) / sizeof(frame_ops[0]));
+
     while (1) {
         eval_command(com_cmd_prompt());
     }
@@ -261,4 +431,5 @@ void mode_main(void)
 void interrupt high_priority isr()
 {
     usb_service();
+    timer_service();
 }
@@ -8,9 +8,11 @@
 #include "../../arglib.h"
 #include "../../comlib.h"
 #include "../../mode.h"
+#include "../../prof.h"
 #include "../../stock_compat.h"
+#include "../../timer.h"
+#include "../../trace.h"
 
-#define EZZIF_DIP28
 #include "ezzif.h"
 
 int main_debug = 0;
@@ -35,11 +37,20 @@ static const char ADDR_BUS[] = {
     27,
 };
 static const char DATA_BUS[] = {11, 12, 13, 15, 16, 17, 18, 19};
+static zif_bus_t addr_bus;
+static zif_bus_t data_bus;
 
 static inline void print_help(void)
 {
     com_println("open-tl866 (eprom-v)");
     com_println("r addr range   Read from target");
+    com_println("U              Print and reset USB statistics");
+#ifdef PROF
+    com_println("K              Dump and reset profiling counters");
+#endif
+#ifdef TRACE
+    com_println("Y              Dump and clear the event trace");
+#endif
     com_println("h              Print help");
     com_println("V              Print version(s)");
     com_println("b              reset to bootloader");
@@ -47,13 +58,21 @@ static inline void print_help(void)
 
 static void dev_addr(int n)
 {
-    ezzif_bus_w(ADDR_BUS, sizeof(ADDR_BUS), n);
+    ezzif_bus_w(&addr_bus, n);
 }
 
-static void dev_init(void)
+// Pin numbers are DIP28 (ezzif's default package, never changed here)
+// Returns 0 on success, otherwise everything is left off
+static int dev_init(void)
 {
     ezzif_reset();
+    if (ezzif_bus_init(&addr_bus, ADDR_BUS, sizeof(ADDR_BUS)) ||
+        ezzif_bus_init(&data_bus, DATA_BUS, sizeof(DATA_BUS))) {
+        ezzif_reset();
+        return -1;
+    }
 
+    ezzif_begin();
     ezzif_vdd(28, VDD_51); // VCC
     ezzif_vdd(1, VDD_51);  // VPP = VCC
     ezzif_gnd(14);         // VSS
@@ -63,30 +82,52 @@ static void dev_init(void)
 
     // Address bus output to 0
     dev_addr(0);
-    ezzif_bus_dir(ADDR_BUS, sizeof(ADDR_BUS), 0);
+    ezzif_bus_dir(&addr_bus, 0);
+    if (ezzif_commit() || ezzif_error()) {
+        ezzif_reset();
+        return -1;
+    }
+    return 0;
 }
 
 static unsigned char read_byte(unsigned int addr)
 {
-    ezzif_bus_w(ADDR_BUS, sizeof(ADDR_BUS), addr);
+    ezzif_bus_w(&addr_bus, addr);
+    __delay_ms(1);
+    return ezzif_bus_r(&data_bus);
+}
+
+// Read addr + 1 right after addr, only moving the address bits that change
+static unsigned char read_next(unsigned int addr)
+{
+    ezzif_bus_step(&addr_bus, addr - 1, addr);
     __delay_ms(1);
-    return ezzif_bus_r(DATA_BUS, sizeof(DATA_BUS));
+    return ezzif_bus_r(&data_bus);
+}
+
+static uint8_t read_source(void *ctx, uint16_t idx)
+{
+    unsigned int addr = *(unsigned int *)ctx;
+
+    return idx ? read_next(addr + idx) : read_byte(addr);
 }
 
 static void eprom_read(unsigned int addr, unsigned int range)
 {
-    printf("%03X ", addr);
-    dev_init();
+    if (dev_init()) {
+        com_println("ERROR: device setup failed");
+        return;
+    }
+    com_print_hex(addr, 3);
+    com_print(" ");
 
     if (!range) {
         range = 1;
     } else {
         com_println("");
     }
-    for (unsigned int byte_idx = 0; byte_idx < range; byte_idx++) {
-        printf("%02X ", read_byte(addr + byte_idx));
-    }
-    printf("\r\n");
+    com_stream_hex_trailing(range, read_source, &addr);
+    com_println("");
 
     ezzif_reset();
 }
@@ -109,6 +150,22 @@ static inline void eval_command(char *cmd)
         break;
     }
 
+    case 'U':
+        com_stats_print();
+        break;
+
+#ifdef PROF
+    case 'K':
+        prof_dump();
+        break;
+#endif
+
+#ifdef TRACE
+    case 'Y':
+        trace_dump();
+        break;
+#endif
+
     case '?':
     case 'h':
         print_help();
@@ -132,9 +189,41 @@ static inline void eval_command(char *cmd)
     }
 }
 
+/*
+Binary ops
+r: addr (u16), range (u16) => data
+*/
+static void frame_read(const uint8_t *req, uint16_t len)
+{
+    unsigned int addr;
+    unsigned int range;
+
+    if (len != 4) {
+        com_frame_reply(COM_FRAME_E_ARG, 0);
+        return;
+    }
+    addr = COM_U16(req);
+    range = COM_U16(req + 2);
+
+    if (dev_init()) {
+        com_frame_reply(COM_FRAME_E_ARG, 0);
+        return;
+    }
+    com_frame_reply(COM_FRAME_OK, range);
+    for (unsigned int i = 0; i < range; i++) {
+        com_frame_put(i ? read_next(addr + i) : read_byte(addr));
+    }
+    ezzif_reset();
+}
+
+static const com_frame_op_t frame_ops[] = {
+    {'r', frame_read},
+};
+
 void mode_main(void)
 {
     ezzif_reset();
+    com_frame_ops(frame_ops, sizeof(frame_ops) / sizeof(frame_ops[0]));
 
     while (1) {
         eval_command(com_cmd_prompt());
@@ -144,4 +233,5 @@ void mode_main(void)
 void interrupt high_priority isr()
 {
     usb_service();
+    timer_service();
 }
@@ -3,10 +3,15 @@
 // #include "epromv.h"
 #include "../../comlib.h"
 #include "../../mode.h"
+#include "../../prof.h"
 #include "../../stock_compat.h"
+#include "../../timer.h"
+#include "../../trace.h"
 
 #include "ezzif.h"
 
+#include <stdlib.h>
+
 int main_debug = 0;
 
 static inline void print_help(void)
@@ -18,7 +23,15 @@ static inline void print_help(void)
     com_println("3      VDD sweep test");
     com_println("4      multiple voltage rail test");
     com_println("5      no ground test");
+    com_println("P pins DIP package, 8 to 40 pins (default 28)");
     com_println("d      debug status");
+    com_println("U      print and reset USB statistics");
+#ifdef PROF
+    com_println("K      dump and reset profiling counters");
+#endif
+#ifdef TRACE
+    com_println("Y      dump and clear the event trace");
+#endif
     com_println("b      reset to bootloader");
 }
 
@@ -54,12 +67,14 @@ static void test_io(void)
 static void test_bus(void)
 {
     static const char BUS[] = {1, 2};
+    zif_bus_t bus;
 
     com_println("Bus test");
     ezzif_gnd_d40(40);
-    ezzif_bus_dir(BUS, sizeof(BUS), 0);
+    ezzif_bus_init(&bus, BUS, sizeof(BUS));
+    ezzif_bus_dir(&bus, 0);
     for (unsigned i = 0; i < 4; ++i) {
-        ezzif_bus_w(BUS, sizeof(BUS), i);
+        ezzif_bus_w(&bus, i);
         printf("Set bus: %u\r\n", i);
         prompt_enter();
     }
@@ -204,6 +219,16 @@ static inline void eval_command(unsigned char *cmd)
         test_gnd();
         break;
 
+    // DIP package size, kept until changed
+    case 'P': {
+        const char *arg = strtok(NULL, " ");
+
+        if (!arg || ezzif_package(atoi(arg)) == 0) {
+            printf("DIP%u\r\n", ezzif_package_pins());
+        }
+        break;
+    }
+
     case 'd': {
         main_debug = 1;
         ezzif_print_debug();
@@ -215,6 +240,22 @@ static inline void eval_command(unsigned char *cmd)
         break;
     }
 
+    case 'U':
+        com_stats_print();
+        break;
+
+#ifdef PROF
+    case 'K':
+        prof_dump();
+        break;
+#endif
+
+#ifdef TRACE
+    case 'Y':
+        trace_dump();
+        break;
+#endif
+
     case '?':
     case 'h':
         print_help();
@@ -231,9 +272,29 @@ static inline void eval_command(unsigned char *cmd)
     ezzif_reset();
 }
 
+/*
+Binary ops, same letters as the text commands
+P: [pins (u8)] => pins (u8) of the selected package
+*/
+
+static void frame_package(const uint8_t *req, uint16_t len)
+{
+    if (len > 1 || (len && ezzif_package(req[0]))) {
+        com_frame_reply(COM_FRAME_E_ARG, 0);
+        return;
+    }
+    com_frame_reply(COM_FRAME_OK, 1);
+    com_frame_put(ezzif_package_pins());
+}
+
+static const com_frame_op_t frame_ops[] = {
+    {'P', frame_package},
+};
+
 void mode_main(void)
 {
     ezzif_reset();
+    com_frame_ops(frame_ops, sizeof(frame_ops) / sizeof(frame_ops[0]));
 
     while (1) {
         eval_command(com_cmd_prompt());
@@ -243,4 +304,5 @@ void mode_main(void)
 void interrupt high_priority isr()
 {
     usb_service();
+    timer_service();
 }
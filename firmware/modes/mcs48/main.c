@@ -4,8 +4,11 @@
 #include "../../comlib.h"
 #include "../../io.h"
 #include "../../mode.h"
+#include "../../prof.h"
 #include "../../stock_compat.h"
 #include "../../system.h"
+#include "../../timer.h"
+#include "../../trace.h"
 
 /*
  * Pin map:
@@ -48,6 +51,10 @@ zif_bits_t pins_vpp = {0x00, 0x00, 0x00, 0x00, 0x10};
 // Vss = P01
 zif_bits_t pins_gnd = {0x01, 0x00, 0x00, 0x00, 0x00};
 
+// A0-A7 (RE0-RE7), A8-A10 (RD0-RD2)
+static const char ADDR_PINS[] = {17, 24, 19, 20, 21, 22, 23, 18, 13, 14, 15};
+static zif_bus_t addr_bus;
+
 // delays by the given number of target clock cycles
 static inline void delay_clock(int cycles)
 {
@@ -70,6 +77,7 @@ static void dev_init()
 {
     io_init();
     LED = 1;
+    zif_bus_init(&addr_bus, ADDR_PINS, sizeof(ADDR_PINS));
 
     vdd_val(VDD_51);  //  5V
     vpp_val(VPP_126); // 12V
@@ -103,13 +111,11 @@ static void dev_off()
     LED = 0;
 }
 
-static uint8_t read_byte(uint16_t addr)
+// Address already on the bus
+static uint8_t read_cycle(void)
 {
     uint8_t value;
 
-    PORTE = addr & 0xFF;
-    PORTD = (addr >> 8) & 0x07;
-
     // MCS-48 Family Users Manual (Jul '78) page 6-7
     // tAW - address setup time to RESET high - 4tCY
     delay_inst(4);
@@ -126,20 +132,40 @@ static uint8_t read_byte(uint16_t addr)
     value = PORTE;
 
     PIN_RESET = 0;
+    // LATE still holds the address, so the next read can step from it
     TRISE = 0x00;
 
     return value;
 }
 
+static uint8_t read_byte(uint16_t addr)
+{
+    zif_bus_w(&addr_bus, addr);
+    return read_cycle();
+}
+
+// Read addr right after addr - 1
+static uint8_t read_next(uint16_t addr)
+{
+    zif_bus_step(&addr_bus, addr - 1, addr);
+    return read_cycle();
+}
+
+static uint8_t read_source(void *ctx, uint16_t idx)
+{
+    uint16_t addr = *(uint16_t *)ctx;
+
+    return idx ? read_next(addr + idx) : read_byte(addr);
+}
+
 static void print_read(uint16_t addr, uint16_t length)
 {
     dev_init();
 
-    printf("%04X ", addr);
-    for (uint16_t idx = 0; idx < length; idx++) {
-        printf("%02X ", read_byte(addr + idx));
-    }
-    printf("\r\n");
+    com_print_hex(addr, 4);
+    com_print(" ");
+    com_stream_hex_trailing(length, read_source, &addr);
+    com_println("");
 
     dev_off();
 }
@@ -147,32 +173,7 @@ static void print_read(uint16_t addr, uint16_t length)
 static void ihex_read(uint16_t addr, uint16_t length)
 {
     dev_init();
-
-    int count = 16;
-    uint16_t end = addr + length;
-    uint8_t val;
-    uint8_t sum = 0;
-
-    for (uint16_t end = addr + length; addr < end; addr += 16) {
-        if (end - addr < 16) {
-            count = end - addr;
-        }
-
-        printf(":%02x%04x00", count, addr);
-        sum = count + (addr >> 8 & 0xFF) + (addr & 0xFF);
-
-        for (uint16_t idx = 0; idx < count; idx++) {
-            val = read_byte(addr + idx);
-            sum += val;
-            printf("%02x", val);
-        }
-
-        printf("%02x\r\n", -sum & 0xFF);
-    }
-
-    // end-of-file record
-    printf(":00000001FF\r\n");
-
+    com_stream_ihex(addr, length, read_source, &addr);
     dev_off();
 }
 
@@ -183,6 +184,13 @@ static inline void print_help(void)
     com_println("i addr range  read from target to Intel HEX");
     com_println("f             freerun (device on, no read)");
     com_println("F             stop freerun (device off)");
+    com_println("U             print and reset USB statistics");
+#ifdef PROF
+    com_println("K             dump and reset profiling counters");
+#endif
+#ifdef TRACE
+    com_println("Y             dump and clear the event trace");
+#endif
     com_println("h             show this help");
     com_println("b             reset to bootloader");
     com_println("(all parameters in hex)");
@@ -212,6 +220,22 @@ static inline void eval_command(char *cmd)
         dev_off();
         break;
 
+    case 'U':
+        com_stats_print();
+        break;
+
+#ifdef PROF
+    case 'K':
+        prof_dump();
+        break;
+#endif
+
+#ifdef TRACE
+    case 'Y':
+        trace_dump();
+        break;
+#endif
+
     case '?':
     case 'h':
         print_help();
@@ -227,9 +251,40 @@ static inline void eval_command(char *cmd)
     }
 }
 
+/*
+Binary ops
+r, i: addr (u16), length (u16) => data
+Both answer raw bytes, there is no Intel HEX framing on the binary side
+*/
+static void frame_read(const uint8_t *req, uint16_t len)
+{
+    uint16_t addr;
+    uint16_t length;
+
+    if (len != 4) {
+        com_frame_reply(COM_FRAME_E_ARG, 0);
+        return;
+    }
+    addr = COM_U16(req);
+    length = COM_U16(req + 2);
+
+    dev_init();
+    com_frame_reply(COM_FRAME_OK, length);
+    for (uint16_t idx = 0; idx < length; idx++) {
+        com_frame_put(idx ? read_next(addr + idx) : read_byte(addr));
+    }
+    dev_off();
+}
+
+static const com_frame_op_t frame_ops[] = {
+    {'r', frame_read},
+    {'i', frame_read},
+};
+
 void mode_main(void)
 {
     LED = 0;
+    com_frame_ops(frame_ops, sizeof(frame_ops) / sizeof(frame_ops[0]));
 
     while (1) {
         eval_command(com_cmd_prompt());
@@ -239,4 +294,5 @@ void mode_main(void)
 void interrupt high_priority isr()
 {
     usb_service();
+    timer_service();
 }
@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "comlib.h"
+#include "io.h"
+#include "pinvm.h"
+#include "timer.h"
+
+// Read bytes per output line
+#define PINVM_OUT_MAX 32
+
+static unsigned char prog[PINVM_PROG_MAX];
+static unsigned prog_len;
+static zif_bus_t buses[PINVM_BUSES];
+
+static unsigned char out[PINVM_OUT_MAX];
+static unsigned char out_len;
+
+static const char hexdig[] = "0123456789ABCDEF";
+
+static void out_flush(void)
+{
+    char line[2 * PINVM_OUT_MAX + 1];
+
+    if (!out_len) {
+        return;
+    }
+    for (unsigned char i = 0; i < out_len; i++) {
+        line[2 * i] = hexdig[out[i] >> 4];
+        line[2 * i + 1] = hexdig[out[i] & 0xF];
+    }
+    line[2 * out_len] = 0;
+    com_println(line);
+    out_len = 0;
+}
+
+static void out_byte(unsigned char b)
+{
+    out[out_len++] = b;
+    if (out_len == PINVM_OUT_MAX) {
+        out_flush();
+    }
+}
+
+static void delay_us(uint16_t us)
+{
+    // Timer1 wraps every ~5.4ms, wait in 1ms steps
+    while (us > 1000) {
+        timer_wait_since(timer_now(), TIMER_US(1000));
+        us -= 1000;
+    }
+    timer_wait_since(timer_now(), TIMER_US(us));
+}
+
+int pinvm_load(unsigned off, const unsigned char *buf, unsigned len)
+{
+    if (off > prog_len || off + len > PINVM_PROG_MAX) {
+        return -1;
+    }
+    memcpy(prog + off, buf, len);
+    prog_len = off + len;
+    return 0;
+}
+
+int pinvm_run(void)
+{
+    struct {
+        unsigned pc;
+        uint16_t count;
+    } loops[PINVM_LOOPS];
+    unsigned char nloops = 0;
+    unsigned pc = 0;
+    unsigned at = 0;
+    uint16_t addr = 0;
+    const char *err = NULL;
+
+    out_len = 0;
+    while (!err) {
+        unsigned char op;
+        unsigned args;
+        const unsigned char *a;
+
+        at = pc;
+        if (pc >= prog_len) {
+            err = "missing END";
+            break;
+        }
+        op = prog[pc];
+        switch (op) {
+        case PINVM_OP_END:
+        case PINVM_OP_ZR:
+        case PINVM_OP_NEXT:
+        case PINVM_OP_FLUSH:
+            args = 0;
+            break;
+        case PINVM_OP_BW:
+        case PINVM_OP_AINC:
+        case PINVM_OP_BR:
+            args = 1;
+            break;
+        case PINVM_OP_DLY:
+        case PINVM_OP_LOOP:
+        case PINVM_OP_ASET:
+        case PINVM_OP_PW:
+            args = 2;
+            break;
+        case PINVM_OP_ZW:
+        case PINVM_OP_ZT:
+            args = 5;
+            break;
+        case PINVM_OP_BUS:
+            args = pc + 2 < prog_len ? 2 + prog[pc + 2] : 2;
+            break;
+        default:
+            err = "bad opcode";
+            continue;
+        }
+        if (pc + 1 + args > prog_len) {
+            err = "truncated";
+            break;
+        }
+        a = &prog[pc + 1];
+        pc += 1 + args;
+        // Ops taking a bus id
+        if ((op == PINVM_OP_BUS || op == PINVM_OP_BW || op == PINVM_OP_AINC ||
+             op == PINVM_OP_BR) &&
+            a[0] >= PINVM_BUSES) {
+            err = "bad bus";
+            break;
+        }
+
+        switch (op) {
+        case PINVM_OP_END:
+            out_flush();
+            return 0;
+
+        case PINVM_OP_ZW:
+            zif_write((unsigned char *)a);
+            break;
+
+        case PINVM_OP_ZT:
+            dir_write((unsigned char *)a);
+            break;
+
+        case PINVM_OP_ZR: {
+            zif_bits_t zif;
+
+            zif_read(zif);
+            for (unsigned char i = 0; i < 5; i++) {
+                out_byte(zif[i]);
+            }
+            break;
+        }
+
+        case PINVM_OP_DLY:
+            delay_us(a[0] | (a[1] << 8));
+            break;
+
+        case PINVM_OP_LOOP:
+            if (nloops == PINVM_LOOPS) {
+                err = "loops nested too deep";
+                break;
+            }
+            loops[nloops].pc = pc;
+            loops[nloops].count = a[0] | (a[1] << 8);
+            nloops++;
+            break;
+
+        case PINVM_OP_NEXT:
+            if (!nloops) {
+                err = "NEXT without LOOP";
+                break;
+            }
+            // Count 0 runs 65536 times
+            if (--loops[nloops - 1].count) {
+                pc = loops[nloops - 1].pc;
+            } else {
+                nloops--;
+            }
+            break;
+
+        case PINVM_OP_BUS:
+            if (zif_bus_init(&buses[a[0]], (const char *)&a[2], a[1])) {
+                err = "bad bus pins";
+            }
+            break;
+
+        case PINVM_OP_BW:
+            zif_bus_w(&buses[a[0]], addr);
+            break;
+
+        case PINVM_OP_AINC:
+            zif_bus_step(&buses[a[0]], addr, addr + 1);
+            addr++;
+            break;
+
+        case PINVM_OP_BR: {
+            uint16_t val = zif_bus_r(&buses[a[0]]);
+
+            out_byte(val);
+            if (buses[a[0]].len > 8) {
+                out_byte(val >> 8);
+            }
+            break;
+        }
+
+        case PINVM_OP_ASET:
+            addr = a[0] | (a[1] << 8);
+            break;
+
+        case PINVM_OP_PW: {
+            port_pin_t pin;
+
+            if (a[0] < 1 || a[0] > 40) {
+                err = "bad pin";
+                break;
+            }
+            pin = zif2pin[a[0] - 1];
+            vid_settle_wait();
+            if (a[1]) {
+                *lat_regs[pin.bank] |= pin.mask;
+            } else {
+                *lat_regs[pin.bank] &= ~pin.mask;
+            }
+            break;
+        }
+
+        case PINVM_OP_FLUSH:
+            out_flush();
+            break;
+        }
+    }
+
+    out_flush();
+    printf("ERROR: pinvm %s at %u\r\n", err, at);
+    return -1;
+}
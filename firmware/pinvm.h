@@ -0,0 +1,66 @@
+/*
+Pin sequence bytecode VM
+
+A host uploads a small program once (pinvm_load()), then runs it as many
+times as it likes. Programs drive the ZIF socket at MCU speed instead of one
+USB round trip per pin operation.
+
+Program format: opcode byte followed by its operands, multi byte operands
+little endian. ZIF bit masks are 5 bytes, LSB of the first byte is pin 1,
+same as zif_bits_t. Pin numbers are 1 based ZIF pins.
+
+Reads are buffered and sent to the host as lines of hex bytes.
+*/
+
+#ifndef PINVM_H
+#define PINVM_H
+
+#include <stdint.h>
+
+#define PINVM_PROG_MAX  256
+#define PINVM_BUSES     2
+#define PINVM_LOOPS     4
+// Program bytes per load command line ("x 255 " + hex fits com_readline())
+#define PINVM_CHUNK_MAX 28
+
+// End of program
+#define PINVM_OP_END 0x00
+// zif_write(zif bits[5])
+#define PINVM_OP_ZW 0x01
+// dir_write(zif bits[5]), 1 => tristate
+#define PINVM_OP_ZT 0x02
+// zif_read(), emit 5 bytes
+#define PINVM_OP_ZR 0x03
+// Delay u16 microseconds
+#define PINVM_OP_DLY 0x04
+// Loop u16 times (0 => 65536) until the matching NEXT
+#define PINVM_OP_LOOP 0x05
+#define PINVM_OP_NEXT 0x06
+// Compile bus: id, len, pins[len] (LSB first)
+#define PINVM_OP_BUS 0x07
+// Write the address register to bus id
+#define PINVM_OP_BW 0x08
+// Address register += 1, stepping bus id
+#define PINVM_OP_AINC 0x09
+// Read bus id, emit 1 byte (2 if wider than 8 pins, low byte first)
+#define PINVM_OP_BR 0x0A
+// Address register = u16, nothing is written
+#define PINVM_OP_ASET 0x0B
+// Write one pin: pin, value
+#define PINVM_OP_PW 0x0C
+// Send buffered reads now
+#define PINVM_OP_FLUSH 0x0D
+
+/*
+Copy `len` program bytes to offset `off`. Offset 0 starts a new program
+Returns 0 on success
+*/
+int pinvm_load(unsigned off, const unsigned char *buf, unsigned len);
+
+/*
+Run the loaded program
+Returns 0 on success, otherwise an error has been printed
+*/
+int pinvm_run(void);
+
+#endif
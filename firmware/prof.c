@@ -0,0 +1,101 @@
+#ifdef PROF
+
+#include <stdio.h>
+#include <string.h>
+
+#include "prof.h"
+#include "timer.h"
+
+struct prof_counter {
+    uint16_t calls;
+    uint32_t total;
+    uint32_t max;
+};
+
+static struct prof_counter counters[PROF_N];
+
+static const char *const names[PROF_N] = {
+    "write_latch", "zif_write", "zif_read",  "vpp_val",   "vdd_val",
+    "vid_settle",  "usb_tx",    "at89_read", "at89_write",
+};
+
+// Per command counters, a slot is taken by the first use of a letter
+static uint8_t cmd_ids[PROF_CMDS];
+static struct prof_counter cmds[PROF_CMDS];
+static uint8_t cmd_cur;
+static prof_t cmd_start;
+
+static void count(struct prof_counter *c, uint32_t ticks)
+{
+    c->calls++;
+    c->total += ticks;
+    if (ticks > c->max) {
+        c->max = ticks;
+    }
+}
+
+prof_t prof_start(void)
+{
+    return timer_now32();
+}
+
+void prof_end(uint8_t id, prof_t start)
+{
+    count(&counters[id], timer_now32() - start);
+}
+
+void prof_cmd_begin(uint8_t cmd)
+{
+    cmd_cur = cmd;
+    cmd_start = timer_now32();
+}
+
+void prof_cmd_end(void)
+{
+    uint32_t ticks = timer_now32() - cmd_start;
+
+    if (!cmd_cur) {
+        return;
+    }
+    for (uint8_t i = 0; i < PROF_CMDS; i++) {
+        if (!cmd_ids[i]) {
+            cmd_ids[i] = cmd_cur;
+        }
+        if (cmd_ids[i] == cmd_cur) {
+            count(&cmds[i], ticks);
+            break;
+        }
+    }
+    cmd_cur = 0;
+}
+
+static void print_counter(const char *name, const struct prof_counter *c)
+{
+    printf("%-11s %5u %10lu %10lu\r\n", name, c->calls,
+           (unsigned long)c->total, (unsigned long)c->max);
+}
+
+void prof_dump(void)
+{
+    char name[8];
+
+    printf("%-11s %5s %10s %10s  (%lu ticks/s)\r\n", "counter", "calls",
+           "total", "max", (unsigned long)TIMER_HZ);
+    for (uint8_t i = 0; i < PROF_N; i++) {
+        print_counter(names[i], &counters[i]);
+    }
+    for (uint8_t i = 0; i < PROF_CMDS && cmd_ids[i]; i++) {
+        if (cmd_ids[i] & 0x80) {
+            sprintf(name, "frame %c", cmd_ids[i] & 0x7F);
+        } else {
+            sprintf(name, "cmd %c", cmd_ids[i]);
+        }
+        print_counter(name, &cmds[i]);
+    }
+
+    memset(counters, 0, sizeof(counters));
+    memset(cmds, 0, sizeof(cmds));
+    memset(cmd_ids, 0, sizeof(cmd_ids));
+}
+
+#endif
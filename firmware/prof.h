@@ -0,0 +1,59 @@
+/*
+Profiling counters
+
+Calls, total and worst case Timer1 ticks (instruction cycles) per primitive
+and per command, from timer_now32(). Build with PROF defined (cmake
+-DTL866_PROF=ON) to enable, otherwise the macros below compile to nothing.
+Dumped and reset with the 'K' command.
+*/
+
+#ifndef PROF_H
+#define PROF_H
+
+#include <stdint.h>
+
+enum {
+    PROF_WRITE_LATCH = 0,
+    PROF_ZIF_WRITE,
+    PROF_ZIF_READ,
+    PROF_VPP_VAL,
+    PROF_VDD_VAL,
+    // Waiting out VID regulator settling
+    PROF_VID_SETTLE,
+    // Waiting on the host to take buffered output
+    PROF_USB_TX,
+    PROF_AT89_READ,
+    PROF_AT89_WRITE,
+    PROF_N
+};
+
+// Commands timed, by first letter (binary ops have bit 7 set)
+#define PROF_CMDS 8
+
+#ifdef PROF
+
+typedef uint32_t prof_t;
+
+#define PROF_START(v) prof_t v = prof_start()
+#define PROF_END(id, v) prof_end(id, v)
+#define PROF_CMD_BEGIN(c) prof_cmd_begin(c)
+#define PROF_CMD_END() prof_cmd_end()
+
+prof_t prof_start(void);
+void prof_end(uint8_t id, prof_t start);
+void prof_cmd_begin(uint8_t cmd);
+void prof_cmd_end(void);
+
+// Print all counters, then zero them
+void prof_dump(void);
+
+#else
+
+#define PROF_START(v)
+#define PROF_END(id, v)
+#define PROF_CMD_BEGIN(c)
+#define PROF_CMD_END()
+
+#endif
+
+#endif
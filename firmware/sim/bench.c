@@ -0,0 +1,447 @@
+/*
+Microbenchmark of the firmware primitives on the simulated PIC
+
+Prints per call: I/O register (PORTx / LATx / TRISx) reads and writes,
+other SFR accesses, 74HC373 latch writes, USB IN packets and simulated
+instruction cycles. Counts are deterministic, so a data layout or batching
+change shows up as a diff of this output.
+
+The models are first checked against the firmware's own view of the
+hardware; any mismatch exits non-zero (ctest runs this).
+
+    tl866-bench [iterations]
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "at89.h"
+#include "comlib.h"
+#include "io.h"
+#include "sim.h"
+
+// xc.h sends printf() to the fake USB, results go to stdout
+#undef printf
+
+#define ITERATIONS 16
+
+static int failures;
+
+#define CHECK(cond)                                                            \
+    do {                                                                       \
+        if (!(cond)) {                                                         \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);             \
+            failures++;                                                        \
+        }                                                                      \
+    } while (0)
+
+static void zif_set(zif_bits_t zif, int pin, int val)
+{
+    if (val) {
+        zif[(pin - 1) >> 3] |= 1 << ((pin - 1) & 7);
+    } else {
+        zif[(pin - 1) >> 3] &= ~(1 << ((pin - 1) & 7));
+    }
+}
+
+static int zif_get(const_zif_bits_t zif, int pin)
+{
+    return (zif[(pin - 1) >> 3] >> ((pin - 1) & 7)) & 1;
+}
+
+static void usb_drain(void)
+{
+    uint8_t buf[256];
+
+    for (uint8_t ep = 0; ep < 4; ep++) {
+        while (sim_usb_host_read(ep, buf, sizeof(buf)))
+            ;
+    }
+}
+
+/****************************************************************************
+AT89C51 target: P0 answers with at89_rom() of the address on P1 / P2.0-3
+****************************************************************************/
+
+static const char at89_addr_pins[] = {1, 2, 3, 4, 5, 6, 7, 8, 21, 22, 23, 24};
+static const char at89_data_pins[] = {39, 38, 37, 36, 35, 34, 33, 32};
+
+static uint8_t at89_rom(uint16_t addr)
+{
+    return (addr * 7 + 3) ^ (addr >> 8);
+}
+
+static void at89_target(const port_bits_t lat, port_bits_t pins)
+{
+    port_bits_t ports;
+    zif_bits_t zif = {0};
+    uint16_t addr = 0;
+    uint8_t data;
+
+    memcpy(ports, lat, sizeof(ports));
+    ports_to_zif_pins(ports, zif);
+    for (uint8_t i = 0; i < sizeof(at89_addr_pins); i++) {
+        addr |= zif_get(zif, at89_addr_pins[i]) << i;
+    }
+    data = at89_rom(addr);
+    memset(zif, 0, sizeof(zif));
+    for (uint8_t i = 0; i < sizeof(at89_data_pins); i++) {
+        zif_set(zif, at89_data_pins[i], (data >> i) & 1);
+    }
+    zif_pins_to_ports(zif, pins);
+}
+
+/****************************************************************************
+Frames, see comlib.c for the layout
+****************************************************************************/
+
+static uint16_t crc16(uint16_t crc, const uint8_t *buf, uint16_t len)
+{
+    while (len--) {
+        crc ^= (uint16_t)*buf++ << 8;
+        for (uint8_t i = 0; i < 8; i++) {
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+static uint16_t frame_build(uint8_t *out, uint8_t op, uint8_t seq,
+                            const uint8_t *payload, uint16_t len)
+{
+    uint16_t crc;
+
+    out[0] = COM_FRAME_ESC;
+    out[1] = len & 0xFF;
+    out[2] = len >> 8;
+    out[3] = op;
+    out[4] = seq;
+    memcpy(out + 5, payload, len);
+    crc = crc16(0xFFFF, out + 1, len + 4);
+    out[5 + len] = crc & 0xFF;
+    out[6 + len] = crc >> 8;
+    return len + 7;
+}
+
+// Send a frame on the bulk interface and let com_readline() handle it
+static void frame_run(uint8_t op, uint8_t seq, const uint8_t *payload,
+                      uint16_t len)
+{
+    uint8_t buf[COM_FRAME_MAX + 7];
+
+    sim_usb_host_write(COM_BULK_ENDPOINT, buf,
+                       frame_build(buf, op, seq, payload, len));
+    // An empty line gets com_readline() back to us
+    sim_usb_host_write(COM_ENDPOINT, "\n", 1);
+    com_readline();
+}
+
+/****************************************************************************
+Model checks
+****************************************************************************/
+
+static void check_latches(void)
+{
+    for (uint8_t i = 0; i < 8; i++) {
+        CHECK(sim_latch[i] == latch_cache[i]);
+    }
+}
+
+static void check_power(void)
+{
+    power_plan_t plan = {0};
+
+    io_init();
+    check_latches();
+
+    zif_set(plan.vpp, 1, 1);
+    zif_set(plan.vdd, 40, 1);
+    zif_set(plan.gnd, 20, 1);
+    zif_set(plan.gnd, 16, 1);
+    power_plan_apply(&plan);
+    check_latches();
+
+    memset(&plan, 0, sizeof(plan));
+    zif_set(plan.vdd, 32, 1);
+    power_plan_apply(&plan);
+    check_latches();
+}
+
+static void check_zif(void)
+{
+    zif_bits_t out = {0x5A, 0xC3, 0x99, 0x0F, 0xA5};
+    zif_bits_t pins = {0x12, 0x34, 0x56, 0x78, 0x9A};
+    zif_bits_t dir = {0};
+    zif_bits_t lat = {0};
+    zif_bits_t in = {0};
+
+    io_init();
+    dir_write(dir);
+    zif_write(out);
+    zif_lat_read(lat);
+    zif_read(in);
+    CHECK(!memcmp(lat, out, sizeof(out)));
+    CHECK(!memcmp(in, out, sizeof(out)));
+
+    // Inputs see the pins, not the latches
+    memset(dir, 0xFF, sizeof(dir));
+    dir_write(dir);
+    memset(sim_pins, 0, sizeof(sim_pins));
+    zif_pins_to_ports(pins, sim_pins);
+    zif_read(in);
+    CHECK(!memcmp(in, pins, sizeof(pins)));
+}
+
+static void check_at89(void)
+{
+    io_init();
+    sim_target = at89_target;
+    at89_read_begin(0);
+    for (uint16_t addr = 0; addr < 0x1000; addr += 0x111) {
+        CHECK(at89_read_next(addr) == at89_rom(addr));
+    }
+    at89_read_end();
+    sim_target = NULL;
+}
+
+static void check_ping(void)
+{
+    static const uint8_t payload[] = {1, 2, 3, 0xA5, 0};
+    uint8_t status[sizeof(payload) + 1];
+    uint8_t want[32];
+    uint8_t reply[32];
+    uint16_t n;
+
+    disable_echo();
+    usb_drain();
+    frame_run(COM_FRAME_OP_PING, 7, payload, sizeof(payload));
+    // Status byte, then the payload
+    status[0] = COM_FRAME_OK;
+    memcpy(status + 1, payload, sizeof(payload));
+    n = frame_build(want, COM_FRAME_OP_PING, 7, status, sizeof(status));
+    CHECK(sim_usb_host_read(COM_BULK_ENDPOINT, reply, sizeof(reply)) == n);
+    CHECK(!memcmp(want, reply, n));
+}
+
+// A bad length is answered at once, not after 64K of payload
+static void check_frame_len(void)
+{
+    static const uint8_t hdr[] = {COM_FRAME_ESC, 0xFF, 0xFF};
+    static const uint8_t status[] = {COM_FRAME_E_LEN};
+    uint8_t want[32];
+    uint8_t reply[32];
+    uint16_t n;
+
+    usb_drain();
+    sim_usb_host_write(COM_BULK_ENDPOINT, hdr, sizeof(hdr));
+    sim_usb_host_write(COM_ENDPOINT, "\n", 1);
+    com_readline();
+    n = frame_build(want, 0, 0, status, sizeof(status));
+    CHECK(sim_usb_host_read(COM_BULK_ENDPOINT, reply, sizeof(reply)) == n);
+    CHECK(!memcmp(want, reply, n));
+    // Back in sync for the next frame
+    check_ping();
+}
+
+// A write stream aborted by comlib still finishes the progress record
+static void check_wr_abort(void)
+{
+    static const uint8_t sink_len[] = {16, 0};
+    static const uint8_t data[32];
+    uint8_t rec[16];
+
+    usb_drain();
+    com_progress_begin('W', 16);
+    frame_run(COM_FRAME_OP_SINK, 1, sink_len, sizeof(sink_len));
+    // More than the stream length: E_LEN
+    frame_run(COM_FRAME_OP_DATA, 0, data, sizeof(data));
+    usb_drain();
+    com_sof();
+    CHECK(sim_usb_host_read(COM_NOTIFY_ENDPOINT, rec, sizeof(rec)) == 16);
+    CHECK(rec[9] == COM_PROGRESS_DONE);
+}
+
+/****************************************************************************
+Benchmarks
+****************************************************************************/
+
+static zif_bus_t bus_addr;
+static zif_bus_t bus_data;
+static const zif_bits_t zif_a = {0x5A, 0xC3, 0x99, 0x0F, 0xA5};
+static const zif_bits_t zif_b = {0xA5, 0x3C, 0x66, 0xF0, 0x5A};
+
+static void run_write_shreg(unsigned i)
+{
+    write_shreg(i);
+}
+
+static void run_write_latch(unsigned i)
+{
+    write_latch(i & 7, i);
+}
+
+static void run_zif_write(unsigned i)
+{
+    zif_bits_t zif;
+
+    memcpy(zif, i & 1 ? zif_b : zif_a, sizeof(zif));
+    zif_write(zif);
+}
+
+static void run_zif_read(unsigned i)
+{
+    zif_bits_t zif;
+
+    (void)i;
+    zif_read(zif);
+}
+
+static void run_dir_write(unsigned i)
+{
+    zif_bits_t zif;
+
+    memcpy(zif, i & 1 ? zif_b : zif_a, sizeof(zif));
+    dir_write(zif);
+}
+
+static void run_bus_w(unsigned i)
+{
+    zif_bus_w(&bus_data, i * 37);
+}
+
+static void run_bus_step(unsigned i)
+{
+    zif_bus_step(&bus_addr, ZIF_GRAY(i), ZIF_GRAY(i + 1));
+}
+
+static void run_bus_r(unsigned i)
+{
+    (void)i;
+    zif_bus_r(&bus_data);
+}
+
+static void run_power_plan(unsigned i)
+{
+    power_plan_t plan = {0};
+
+    zif_set(plan.vdd, i & 1 ? 40 : 32, 1);
+    zif_set(plan.gnd, 20, 1);
+    zif_set(plan.vpp, i & 1 ? 1 : 31, 1);
+    power_plan_apply(&plan);
+}
+
+static void run_vpp_val(unsigned i)
+{
+    vpp_val(i);
+}
+
+static void run_at89_read_next(unsigned i)
+{
+    at89_read_next(i);
+}
+
+static void run_com_print(unsigned i)
+{
+    (void)i;
+    com_println("0123456789ABCDEF0123456789ABCDEF0123456789ABCDEF0123456789");
+    com_flush();
+    usb_drain();
+}
+
+static void run_ping(unsigned i)
+{
+    static const uint8_t payload[8];
+
+    frame_run(COM_FRAME_OP_PING, i, payload, sizeof(payload));
+    usb_drain();
+}
+
+static void setup_io(void)
+{
+    io_init();
+}
+
+static void setup_bus(void)
+{
+    io_init();
+    zif_bus_init(&bus_addr, at89_addr_pins, sizeof(at89_addr_pins));
+    zif_bus_init(&bus_data, at89_data_pins, sizeof(at89_data_pins));
+    zif_bus_dir(&bus_addr, 0);
+    zif_bus_dir(&bus_data, 0);
+}
+
+static void setup_at89(void)
+{
+    io_init();
+    at89_read_begin(0);
+}
+
+static void setup_com(void)
+{
+    disable_echo();
+    usb_drain();
+}
+
+static const struct bench {
+    const char *name;
+    void (*setup)(void);
+    void (*run)(unsigned i);
+} benches[] = {
+    {"write_shreg", setup_io, run_write_shreg},
+    {"write_latch", setup_io, run_write_latch},
+    {"zif_write", setup_io, run_zif_write},
+    {"zif_read", setup_io, run_zif_read},
+    {"dir_write", setup_io, run_dir_write},
+    {"zif_bus_w", setup_bus, run_bus_w},
+    {"zif_bus_step", setup_bus, run_bus_step},
+    {"zif_bus_r", setup_bus, run_bus_r},
+    {"power_plan_apply", setup_io, run_power_plan},
+    {"vpp_val", setup_io, run_vpp_val},
+    {"at89_read_next", setup_at89, run_at89_read_next},
+    {"com_println", setup_com, run_com_print},
+    {"frame_ping", setup_com, run_ping},
+};
+
+static void bench_run(const struct bench *b, unsigned iterations)
+{
+    sim_counts_t start;
+    sim_counts_t *end = &sim_counts;
+    double n = iterations;
+
+    b->setup();
+    start = sim_counts;
+    for (unsigned i = 0; i < iterations; i++) {
+        b->run(i);
+    }
+    printf("%-18s %8.1f %8.1f %8.1f %8.1f %8.1f %10.1f\n", b->name,
+           (end->io_reads - start.io_reads) / n,
+           (end->io_writes - start.io_writes) / n,
+           (end->other - start.other) / n,
+           (end->latch_writes - start.latch_writes) / n,
+           (end->in_packets - start.in_packets) / n,
+           (end->cycles - start.cycles) / n);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned iterations = argc > 1 ? atoi(argv[1]) : ITERATIONS;
+
+    sim_init();
+    check_power();
+    check_zif();
+    check_at89();
+    check_ping();
+    check_frame_len();
+    check_wr_abort();
+    if (failures) {
+        printf("%d model check(s) failed\n", failures);
+        return 1;
+    }
+
+    printf("%-18s %8s %8s %8s %8s %8s %10s\n", "per call", "io_rd",
+           "io_wr", "other", "latch", "usb_in", "cycles");
+    for (unsigned i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        bench_run(&benches[i], iterations);
+    }
+    return 0;
+}
@@ -0,0 +1,30 @@
+/*
+Host stand-in for the part of the M-Stack API comlib uses
+
+The fake bus (sim_usb.c) is an infinitely fast host: IN packets are taken
+as soon as they are sent and OUT packets are whatever sim_usb_host_write()
+queued. No interrupts, so nothing calls com_in_complete().
+*/
+
+#ifndef USB_H__
+#define USB_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "usb_config.h"
+
+bool usb_is_configured(void);
+
+uint8_t *usb_get_in_buffer(uint8_t endpoint);
+void usb_send_in_buffer(uint8_t endpoint, size_t len);
+bool usb_in_endpoint_busy(uint8_t endpoint);
+bool usb_in_endpoint_halted(uint8_t endpoint);
+
+bool usb_out_endpoint_has_data(uint8_t endpoint);
+uint8_t usb_get_out_buffer(uint8_t endpoint, const unsigned char **buffer);
+void usb_arm_out_endpoint(uint8_t endpoint);
+bool usb_out_endpoint_halted(uint8_t endpoint);
+
+#endif
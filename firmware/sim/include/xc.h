@@ -0,0 +1,210 @@
+/*
+Host stand-in for the XC8 device header
+
+Only the SFRs the core sources touch. Each one is a byte of sim_sfr[] at
+its PIC18F87J50 address less SIM_SFR_BASE, so `&PORTA` stays an address
+constant and the register tables in io.c build unchanged. sim.c watches
+every access to sim_sfr[] (see sim.h), nothing here is instrumented.
+*/
+
+#ifndef XC_H
+#define XC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define SIM_SFR_BASE 0xF00
+#define SIM_SFR_SIZE 0x100
+
+extern volatile uint8_t sim_sfr[];
+
+#define SIM_SFR(addr) (sim_sfr[(addr) - SIM_SFR_BASE])
+#define SIM_SFR_BITS(type, addr) (*(volatile type *)&SIM_SFR(addr))
+
+// I/O ports: PORTx, LATx, TRISx for A-H, J (no I)
+#define SIM_PORTA 0xF80
+#define SIM_LATA  0xF89
+#define SIM_TRISA 0xF92
+
+#define SIM_PIE1    0xF9D
+#define SIM_PIR1    0xF9E
+#define SIM_CCP2CON 0xFBA
+#define SIM_CCPR1L  0xFBE
+#define SIM_T2CON   0xFCA
+#define SIM_PR2     0xFCB
+#define SIM_TMR2    0xFCC
+#define SIM_T1CON   0xFCD
+#define SIM_TMR1L   0xFCE
+#define SIM_TMR1H   0xFCF
+#define SIM_INTCON  0xFF2
+
+#define SIM_PORT_BITS(X)                                                       \
+    typedef union {                                                            \
+        uint8_t v;                                                             \
+        struct {                                                               \
+            uint8_t R##X##0 : 1, R##X##1 : 1, R##X##2 : 1, R##X##3 : 1,        \
+                R##X##4 : 1, R##X##5 : 1, R##X##6 : 1, R##X##7 : 1;            \
+        };                                                                     \
+    } PORT##X##bits_t;                                                         \
+    typedef union {                                                            \
+        uint8_t v;                                                             \
+        struct {                                                               \
+            uint8_t LAT##X##0 : 1, LAT##X##1 : 1, LAT##X##2 : 1,               \
+                LAT##X##3 : 1, LAT##X##4 : 1, LAT##X##5 : 1, LAT##X##6 : 1,    \
+                LAT##X##7 : 1;                                                 \
+        };                                                                     \
+    } LAT##X##bits_t;                                                          \
+    typedef union {                                                            \
+        uint8_t v;                                                             \
+        struct {                                                               \
+            uint8_t TRIS##X##0 : 1, TRIS##X##1 : 1, TRIS##X##2 : 1,            \
+                TRIS##X##3 : 1, TRIS##X##4 : 1, TRIS##X##5 : 1,                \
+                TRIS##X##6 : 1, TRIS##X##7 : 1;                                \
+        };                                                                     \
+        /* XC8 also names TRIS bits after the pin */                           \
+        struct {                                                               \
+            uint8_t R##X##0 : 1, R##X##1 : 1, R##X##2 : 1, R##X##3 : 1,        \
+                R##X##4 : 1, R##X##5 : 1, R##X##6 : 1, R##X##7 : 1;            \
+        };                                                                     \
+    } TRIS##X##bits_t;
+
+SIM_PORT_BITS(A)
+SIM_PORT_BITS(B)
+SIM_PORT_BITS(C)
+SIM_PORT_BITS(D)
+SIM_PORT_BITS(E)
+SIM_PORT_BITS(F)
+SIM_PORT_BITS(G)
+SIM_PORT_BITS(H)
+SIM_PORT_BITS(J)
+
+// Bank index: A-H are 0-7, J is 8
+#define PORTA SIM_SFR(SIM_PORTA + 0)
+#define PORTB SIM_SFR(SIM_PORTA + 1)
+#define PORTC SIM_SFR(SIM_PORTA + 2)
+#define PORTD SIM_SFR(SIM_PORTA + 3)
+#define PORTE SIM_SFR(SIM_PORTA + 4)
+#define PORTF SIM_SFR(SIM_PORTA + 5)
+#define PORTG SIM_SFR(SIM_PORTA + 6)
+#define PORTH SIM_SFR(SIM_PORTA + 7)
+#define PORTJ SIM_SFR(SIM_PORTA + 8)
+
+#define LATA SIM_SFR(SIM_LATA + 0)
+#define LATB SIM_SFR(SIM_LATA + 1)
+#define LATC SIM_SFR(SIM_LATA + 2)
+#define LATD SIM_SFR(SIM_LATA + 3)
+#define LATE SIM_SFR(SIM_LATA + 4)
+#define LATF SIM_SFR(SIM_LATA + 5)
+#define LATG SIM_SFR(SIM_LATA + 6)
+#define LATH SIM_SFR(SIM_LATA + 7)
+#define LATJ SIM_SFR(SIM_LATA + 8)
+
+#define TRISA SIM_SFR(SIM_TRISA + 0)
+#define TRISB SIM_SFR(SIM_TRISA + 1)
+#define TRISC SIM_SFR(SIM_TRISA + 2)
+#define TRISD SIM_SFR(SIM_TRISA + 3)
+#define TRISE SIM_SFR(SIM_TRISA + 4)
+#define TRISF SIM_SFR(SIM_TRISA + 5)
+#define TRISG SIM_SFR(SIM_TRISA + 6)
+#define TRISH SIM_SFR(SIM_TRISA + 7)
+#define TRISJ SIM_SFR(SIM_TRISA + 8)
+
+#define PORTAbits SIM_SFR_BITS(PORTAbits_t, SIM_PORTA + 0)
+#define PORTBbits SIM_SFR_BITS(PORTBbits_t, SIM_PORTA + 1)
+#define PORTCbits SIM_SFR_BITS(PORTCbits_t, SIM_PORTA + 2)
+#define PORTDbits SIM_SFR_BITS(PORTDbits_t, SIM_PORTA + 3)
+#define PORTEbits SIM_SFR_BITS(PORTEbits_t, SIM_PORTA + 4)
+#define PORTFbits SIM_SFR_BITS(PORTFbits_t, SIM_PORTA + 5)
+#define PORTGbits SIM_SFR_BITS(PORTGbits_t, SIM_PORTA + 6)
+#define PORTHbits SIM_SFR_BITS(PORTHbits_t, SIM_PORTA + 7)
+#define PORTJbits SIM_SFR_BITS(PORTJbits_t, SIM_PORTA + 8)
+
+#define LATAbits SIM_SFR_BITS(LATAbits_t, SIM_LATA + 0)
+#define LATBbits SIM_SFR_BITS(LATBbits_t, SIM_LATA + 1)
+#define LATCbits SIM_SFR_BITS(LATCbits_t, SIM_LATA + 2)
+#define LATDbits SIM_SFR_BITS(LATDbits_t, SIM_LATA + 3)
+#define LATEbits SIM_SFR_BITS(LATEbits_t, SIM_LATA + 4)
+#define LATFbits SIM_SFR_BITS(LATFbits_t, SIM_LATA + 5)
+#define LATGbits SIM_SFR_BITS(LATGbits_t, SIM_LATA + 6)
+#define LATHbits SIM_SFR_BITS(LATHbits_t, SIM_LATA + 7)
+#define LATJbits SIM_SFR_BITS(LATJbits_t, SIM_LATA + 8)
+
+#define TRISAbits SIM_SFR_BITS(TRISAbits_t, SIM_TRISA + 0)
+#define TRISBbits SIM_SFR_BITS(TRISBbits_t, SIM_TRISA + 1)
+#define TRISCbits SIM_SFR_BITS(TRISCbits_t, SIM_TRISA + 2)
+#define TRISDbits SIM_SFR_BITS(TRISDbits_t, SIM_TRISA + 3)
+#define TRISEbits SIM_SFR_BITS(TRISEbits_t, SIM_TRISA + 4)
+#define TRISFbits SIM_SFR_BITS(TRISFbits_t, SIM_TRISA + 5)
+#define TRISGbits SIM_SFR_BITS(TRISGbits_t, SIM_TRISA + 6)
+#define TRISHbits SIM_SFR_BITS(TRISHbits_t, SIM_TRISA + 7)
+#define TRISJbits SIM_SFR_BITS(TRISJbits_t, SIM_TRISA + 8)
+
+typedef union {
+    uint8_t v;
+    struct {
+        uint8_t TMR1IF : 1, TMR2IF : 1, CCP1IF : 1, SSP1IF : 1, TX1IF : 1,
+            RC1IF : 1, ADIF : 1, PMPIF : 1;
+    };
+} PIR1bits_t;
+
+typedef union {
+    uint8_t v;
+    struct {
+        uint8_t TMR1IE : 1, TMR2IE : 1, CCP1IE : 1, SSP1IE : 1, TX1IE : 1,
+            RC1IE : 1, ADIE : 1, PMPIE : 1;
+    };
+} PIE1bits_t;
+
+typedef union {
+    uint8_t v;
+    struct {
+        uint8_t TMR1ON : 1, TMR1CS0 : 1, nT1SYNC : 1, T1OSCEN : 1,
+            T1CKPS0 : 1, T1CKPS1 : 1, T1RUN : 1, RD16 : 1;
+    };
+} T1CONbits_t;
+
+typedef union {
+    uint8_t v;
+    struct {
+        uint8_t RBIF : 1, INT0IF : 1, TMR0IF : 1, RBIE : 1, INT0IE : 1,
+            TMR0IE : 1, PEIE : 1, GIE : 1;
+    };
+} INTCONbits_t;
+
+#define PIE1    SIM_SFR(SIM_PIE1)
+#define PIR1    SIM_SFR(SIM_PIR1)
+#define CCP2CON SIM_SFR(SIM_CCP2CON)
+#define CCPR1L  SIM_SFR(SIM_CCPR1L)
+#define T2CON   SIM_SFR(SIM_T2CON)
+#define PR2     SIM_SFR(SIM_PR2)
+#define TMR2    SIM_SFR(SIM_TMR2)
+#define T1CON   SIM_SFR(SIM_T1CON)
+#define TMR1L   SIM_SFR(SIM_TMR1L)
+#define TMR1H   SIM_SFR(SIM_TMR1H)
+#define INTCON  SIM_SFR(SIM_INTCON)
+
+#define PIE1bits   SIM_SFR_BITS(PIE1bits_t, SIM_PIE1)
+#define PIR1bits   SIM_SFR_BITS(PIR1bits_t, SIM_PIR1)
+#define T1CONbits  SIM_SFR_BITS(T1CONbits_t, SIM_T1CON)
+#define INTCONbits SIM_SFR_BITS(INTCONbits_t, SIM_INTCON)
+
+// Delays just move the simulated clock on
+void sim_delay(uint32_t cycles);
+void sim_reset(void);
+
+#define _delay(cycles) sim_delay(cycles)
+#define __delay_us(us) sim_delay((uint32_t)(us) * (_XTAL_FREQ / 4000000UL))
+#define __delay_ms(ms) sim_delay((uint32_t)(ms) * (_XTAL_FREQ / 4000UL))
+#define NOP()          sim_delay(1)
+#define CLRWDT()
+#define RESET() sim_reset()
+#define di()    (INTCONbits.GIE = 0)
+#define ei()    (INTCONbits.GIE = 1)
+
+// XC8's printf writes through putch(), so does this one
+int sim_printf(const char *fmt, ...);
+#define printf sim_printf
+
+#endif
@@ -0,0 +1,260 @@
+#define _GNU_SOURCE
+
+#include <signal.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+
+#include <xc.h>
+
+#include "sim.h"
+
+#if !defined(__linux__) || !defined(__x86_64__)
+#error "The SFR access trap needs Linux on x86-64"
+#endif
+
+#define SIM_PAGE 4096
+// EFLAGS trap flag: single step
+#define EFL_TF 0x100
+// Page fault error code: write access
+#define PF_WRITE 0x2
+
+// SFR index by port_bits_t bank
+#define PORT_IDX(b) (SIM_PORTA - SIM_SFR_BASE + (b))
+#define LAT_IDX(b)  (SIM_LATA - SIM_SFR_BASE + (b))
+#define TRIS_IDX(b) (SIM_TRISA - SIM_SFR_BASE + (b))
+#define BANK_A      0
+#define BANK_H      7
+#define SR_CLK_BIT  3
+#define SR_DAT_BIT  2
+
+volatile uint8_t sim_sfr[SIM_PAGE] __attribute__((aligned(SIM_PAGE)));
+
+sim_counts_t sim_counts;
+port_bits_t sim_pins;
+void (*sim_target)(const port_bits_t lat, port_bits_t pins);
+uint8_t sim_shreg;
+latch_bits_t sim_latch;
+
+// LE0-7 by port_bits_t bank and bit, see io.h
+static const struct {
+    uint8_t bank;
+    uint8_t bit;
+} le_pins[8] = {
+    {BANK_H, 0}, {BANK_H, 1}, {BANK_A, 2}, {BANK_A, 0},
+    {BANK_A, 5}, {BANK_A, 3}, {BANK_H, 4}, {BANK_A, 1},
+};
+
+// Access being single stepped
+static uint8_t step_idx;
+static bool step_write;
+static uint8_t step_old;
+
+// Timer1 = cycles - timer_base
+static uint32_t timer_base;
+
+static void sfr_open(void)
+{
+    mprotect((void *)sim_sfr, SIM_PAGE, PROT_READ | PROT_WRITE);
+}
+
+static void sfr_close(void)
+{
+    mprotect((void *)sim_sfr, SIM_PAGE, PROT_NONE);
+}
+
+static bool is_io(uint8_t idx)
+{
+    return idx >= PORT_IDX(0) && idx < TRIS_IDX(9);
+}
+
+static uint8_t sfr(uint16_t addr)
+{
+    return sim_sfr[addr - SIM_SFR_BASE];
+}
+
+// Page must be open
+static void tick(uint32_t cycles)
+{
+    uint32_t before = sim_counts.cycles - timer_base;
+
+    sim_counts.cycles += cycles;
+    if ((sfr(SIM_T1CON) & 0x01) && (before & 0xFFFF) + cycles > 0xFFFF) {
+        sim_sfr[SIM_PIR1 - SIM_SFR_BASE] |= 0x01; /* TMR1IF */
+    }
+}
+
+// Pin levels: output latches, the outside world on inputs
+static void port_refresh(void)
+{
+    port_bits_t lat;
+
+    for (uint8_t b = 0; b < 9; b++) {
+        lat[b] = sim_sfr[LAT_IDX(b)];
+    }
+    if (sim_target) {
+        sim_target(lat, sim_pins);
+    }
+    for (uint8_t b = 0; b < 9; b++) {
+        uint8_t tris = sim_sfr[TRIS_IDX(b)];
+
+        sim_sfr[PORT_IDX(b)] = (lat[b] & ~tris) | (sim_pins[b] & tris);
+    }
+}
+
+static void latch_follow(void)
+{
+    for (uint8_t n = 0; n < 8; n++) {
+        if (sim_sfr[LAT_IDX(le_pins[n].bank)] & (1 << le_pins[n].bit)) {
+            sim_latch[n] = sim_shreg;
+        }
+    }
+}
+
+static void lat_written(uint8_t bank, uint8_t old, uint8_t now)
+{
+    uint8_t rise = ~old & now;
+    uint8_t fall = old & ~now;
+
+    // 74HC164: Q0 takes SR_DAT, the rest shift up
+    if (bank == BANK_H && (rise & (1 << SR_CLK_BIT))) {
+        sim_shreg = (sim_shreg << 1) | ((now >> SR_DAT_BIT) & 1);
+        sim_counts.shifts++;
+    }
+    // 74HC373: transparent while LE is high, holds from the falling edge
+    latch_follow();
+    for (uint8_t n = 0; n < 8; n++) {
+        if (le_pins[n].bank == bank && (fall & (1 << le_pins[n].bit))) {
+            sim_latch[n] = sim_shreg;
+            sim_counts.latch_writes++;
+        }
+    }
+}
+
+static void on_segv(int sig, siginfo_t *si, void *ctx)
+{
+    ucontext_t *uc = ctx;
+    uintptr_t off = (uintptr_t)si->si_addr - (uintptr_t)sim_sfr;
+
+    (void)sig;
+    if (off >= SIM_SFR_SIZE) {
+        // A real crash: fault again with the default action
+        signal(SIGSEGV, SIG_DFL);
+        return;
+    }
+    sfr_open();
+    step_idx = off;
+    step_write = (uc->uc_mcontext.gregs[REG_ERR] & PF_WRITE) != 0;
+
+    tick(SIM_ACCESS_CYCLES);
+    if (off >= PORT_IDX(0) && off < PORT_IDX(9)) {
+        port_refresh();
+    } else if (off == SIM_TMR1L - SIM_SFR_BASE && !step_write) {
+        // RD16: reading TMR1L latches TMR1H
+        uint16_t tmr1 = sim_counts.cycles - timer_base;
+
+        sim_sfr[SIM_TMR1L - SIM_SFR_BASE] = tmr1 & 0xFF;
+        sim_sfr[SIM_TMR1H - SIM_SFR_BASE] = tmr1 >> 8;
+    }
+    step_old = sim_sfr[off];
+    uc->uc_mcontext.gregs[REG_EFL] |= EFL_TF;
+}
+
+static void on_trap(int sig, siginfo_t *si, void *ctx)
+{
+    ucontext_t *uc = ctx;
+    uint8_t now = sim_sfr[step_idx];
+
+    (void)sig;
+    (void)si;
+    uc->uc_mcontext.gregs[REG_EFL] &= ~EFL_TF;
+
+    if (!is_io(step_idx)) {
+        sim_counts.other++;
+    } else if (step_write) {
+        sim_counts.io_writes++;
+    } else {
+        sim_counts.io_reads++;
+    }
+
+    if (step_write) {
+        if (step_idx >= PORT_IDX(0) && step_idx < PORT_IDX(9)) {
+            uint8_t bank = step_idx - PORT_IDX(0);
+            uint8_t old = sim_sfr[LAT_IDX(bank)];
+
+            sim_sfr[LAT_IDX(bank)] = now;
+            lat_written(bank, old, now);
+        } else if (step_idx >= LAT_IDX(0) && step_idx < LAT_IDX(9)) {
+            lat_written(step_idx - LAT_IDX(0), step_old, now);
+        } else if (step_idx == SIM_TMR1L - SIM_SFR_BASE) {
+            timer_base = sim_counts.cycles -
+                         ((uint16_t)sfr(SIM_TMR1H) << 8 | now);
+        }
+    }
+    sfr_close();
+}
+
+void sim_init(void)
+{
+    static bool installed;
+
+    if (!installed) {
+        struct sigaction sa;
+
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_flags = SA_SIGINFO;
+        sa.sa_sigaction = on_segv;
+        sigaction(SIGSEGV, &sa, NULL);
+        sa.sa_sigaction = on_trap;
+        sigaction(SIGTRAP, &sa, NULL);
+        installed = true;
+    }
+
+    sfr_open();
+    memset((void *)sim_sfr, 0, SIM_PAGE);
+    for (uint8_t b = 0; b < 9; b++) {
+        sim_sfr[TRIS_IDX(b)] = 0xFF;
+    }
+    sfr_close();
+
+    memset(&sim_counts, 0, sizeof(sim_counts));
+    memset(sim_pins, 0, sizeof(sim_pins));
+    memset(sim_latch, 0, sizeof(sim_latch));
+    sim_target = NULL;
+    sim_shreg = 0;
+    timer_base = 0;
+    sim_usb_reset();
+}
+
+void sim_delay(uint32_t cycles)
+{
+    sfr_open();
+    tick(cycles);
+    sfr_close();
+}
+
+void sim_reset(void)
+{
+    fprintf(stderr, "sim: RESET()\n");
+    abort();
+}
+
+// putch() is comlib's
+void putch(const unsigned char c);
+
+int sim_printf(const char *fmt, ...)
+{
+    char buf[256];
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    for (int i = 0; i < n && i < (int)sizeof(buf) - 1; i++) {
+        putch(buf[i]);
+    }
+    return n;
+}
@@ -0,0 +1,66 @@
+/*
+Host simulation of the TL866 core
+
+The SFR page (sim_sfr[], see include/xc.h) is kept unreadable. Each access
+the firmware makes faults, is counted and modelled, then the instruction is
+single stepped with the page open. Firmware sources build unchanged and
+every access is seen, through the named registers or the io.c tables.
+Linux on x86-64 only. Under gdb: `handle SIGSEGV SIGTRAP nostop noprint`.
+
+Modelled:
+- PORTx reads LATx for outputs, sim_pins[] for inputs. PORTx writes LATx.
+- Timer1 runs off a simulated clock: SIM_ACCESS_CYCLES per SFR access plus
+  every _delay() / __delay_us() / __delay_ms(). Overflow sets TMR1IF.
+- The 74HC164 shift register on SR_CLK / SR_DAT and the eight 74HC373 pin
+  driver latches on LE0-7, wired as in io.h.
+- USB: see include/usb.h.
+No interrupts are simulated.
+*/
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "io.h"
+
+// Rough cycles of surrounding code per SFR access
+#define SIM_ACCESS_CYCLES 4
+
+typedef struct sim_counts {
+    // PORTx / LATx / TRISx. A bit set or clear is a read and a write.
+    uint32_t io_reads;
+    uint32_t io_writes;
+    // Timer, interrupt control, ...
+    uint32_t other;
+    // LEx falling edges
+    uint32_t latch_writes;
+    // SR_CLK rising edges
+    uint32_t shifts;
+    uint32_t in_packets;
+    uint32_t out_packets;
+    uint32_t cycles;
+} sim_counts_t;
+
+extern sim_counts_t sim_counts;
+
+// External level of each input pin, by port_bits_t index
+extern port_bits_t sim_pins;
+// Optional target chip: called before every PORTx access to drive sim_pins
+// from the LATx outputs
+extern void (*sim_target)(const port_bits_t lat, port_bits_t pins);
+// 74HC164 outputs and 74HC373 outputs
+extern uint8_t sim_shreg;
+extern latch_bits_t sim_latch;
+
+// Power on reset state, starts watching the SFR page
+void sim_init(void);
+
+void sim_usb_reset(void);
+// Queue bytes for an OUT endpoint, sent in endpoint sized packets
+void sim_usb_host_write(uint8_t endpoint, const void *buf, uint16_t len);
+// Take up to max bytes the firmware sent on an IN endpoint
+uint16_t sim_usb_host_read(uint8_t endpoint, void *buf, uint16_t max);
+
+#endif
@@ -0,0 +1,118 @@
+#include <string.h>
+
+#include "sim.h"
+#include "usb.h"
+
+#define EPS 4
+
+// 16 bit indexes wrap for free
+struct ep {
+    uint8_t in_buf[64];
+    uint8_t in_ring[0x10000];
+    uint16_t in_head;
+    uint16_t in_tail;
+    uint8_t out_buf[64];
+    uint8_t out_ring[0x10000];
+    uint16_t out_head;
+    uint16_t out_tail;
+    // Bytes handed out by usb_get_out_buffer(), consumed on re-arm
+    uint8_t out_len;
+};
+
+static struct ep eps[EPS];
+
+static const uint8_t out_max[EPS] = {EP_0_LEN, EP_1_OUT_LEN, EP_2_OUT_LEN,
+                                     EP_3_OUT_LEN};
+
+void sim_usb_reset(void)
+{
+    memset(eps, 0, sizeof(eps));
+}
+
+void sim_usb_host_write(uint8_t endpoint, const void *buf, uint16_t len)
+{
+    struct ep *ep = &eps[endpoint];
+    const uint8_t *p = buf;
+
+    while (len--) {
+        ep->out_ring[ep->out_head++] = *p++;
+    }
+}
+
+uint16_t sim_usb_host_read(uint8_t endpoint, void *buf, uint16_t max)
+{
+    struct ep *ep = &eps[endpoint];
+    uint8_t *p = buf;
+    uint16_t n = 0;
+
+    while (n < max && ep->in_tail != ep->in_head) {
+        p[n++] = ep->in_ring[ep->in_tail++];
+    }
+    return n;
+}
+
+bool usb_is_configured(void)
+{
+    return true;
+}
+
+uint8_t *usb_get_in_buffer(uint8_t endpoint)
+{
+    return eps[endpoint].in_buf;
+}
+
+void usb_send_in_buffer(uint8_t endpoint, size_t len)
+{
+    struct ep *ep = &eps[endpoint];
+
+    for (size_t i = 0; i < len; i++) {
+        ep->in_ring[ep->in_head++] = ep->in_buf[i];
+    }
+    sim_counts.in_packets++;
+}
+
+bool usb_in_endpoint_busy(uint8_t endpoint)
+{
+    (void)endpoint;
+    return false;
+}
+
+bool usb_in_endpoint_halted(uint8_t endpoint)
+{
+    (void)endpoint;
+    return false;
+}
+
+bool usb_out_endpoint_has_data(uint8_t endpoint)
+{
+    return eps[endpoint].out_tail != eps[endpoint].out_head;
+}
+
+uint8_t usb_get_out_buffer(uint8_t endpoint, const unsigned char **buffer)
+{
+    struct ep *ep = &eps[endpoint];
+    uint16_t avail = ep->out_head - ep->out_tail;
+    uint8_t n = avail < out_max[endpoint] ? avail : out_max[endpoint];
+
+    for (uint8_t i = 0; i < n; i++) {
+        ep->out_buf[i] = ep->out_ring[(uint16_t)(ep->out_tail + i)];
+    }
+    ep->out_len = n;
+    *buffer = ep->out_buf;
+    return n;
+}
+
+void usb_arm_out_endpoint(uint8_t endpoint)
+{
+    struct ep *ep = &eps[endpoint];
+
+    ep->out_tail += ep->out_len;
+    ep->out_len = 0;
+    sim_counts.out_packets++;
+}
+
+bool usb_out_endpoint_halted(uint8_t endpoint)
+{
+    (void)endpoint;
+    return false;
+}
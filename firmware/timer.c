@@ -0,0 +1,59 @@
+#include <xc.h>
+
+#include "timer.h"
+#include "trace.h"
+
+// Upper 16 bits of timer_now32()
+static volatile uint16_t timer_hi = 0;
+
+void timer_init(void)
+{
+    // RD16: 16 bit reads through TMR1H buffer
+    // 1:1 prescale, internal clock (Fosc/4), no T1 oscillator
+    T1CON = 0x80;
+    TMR1H = 0;
+    TMR1L = 0;
+    PIR1bits.TMR1IF = 0;
+    PIE1bits.TMR1IE = 1;
+    T1CONbits.TMR1ON = 1;
+}
+
+void timer_service(void)
+{
+    if (PIR1bits.TMR1IF) {
+        PIR1bits.TMR1IF = 0;
+        timer_hi++;
+#ifdef TRACE
+        trace_wrap();
+#endif
+    }
+}
+
+uint16_t timer_now(void)
+{
+    // With RD16 set, reading TMR1L latches TMR1H
+    uint8_t lo = TMR1L;
+    return ((uint16_t)TMR1H << 8) | lo;
+}
+
+void timer_wait_since(uint16_t start, uint16_t ticks)
+{
+    while ((uint16_t)(timer_now() - start) < ticks)
+        ;
+}
+
+uint32_t timer_now32(void)
+{
+    uint16_t hi;
+    uint16_t lo;
+
+    do {
+        hi = timer_hi;
+        lo = timer_now();
+    } while (hi != timer_hi);
+    // Wrapped but not serviced yet (ex: interrupts off)
+    if (PIR1bits.TMR1IF && lo < 0x8000) {
+        hi++;
+    }
+    return ((uint32_t)hi << 16) | lo;
+}
@@ -0,0 +1,38 @@
+/*
+ * Free running Timer1 time base
+ *
+ * Timer1 counts instruction cycles (Fosc/4, 12 MHz) and wraps every ~5.4ms.
+ * Interval arithmetic is done on uint16_t so wrap is handled by unsigned
+ * subtraction, as long as the interval measured is shorter than the wrap.
+ *
+ * The overflow interrupt extends it to 32 bits (~6 minutes) for longer
+ * measurements. Every mode's ISR must call timer_service().
+ */
+
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+#include "system.h"
+
+#define TIMER_HZ (_XTAL_FREQ / 4)
+// Ticks in `us` microseconds. Must fit in 16 bits (< 5461us).
+#define TIMER_US(us) ((uint16_t)((us) * (TIMER_HZ / 1000000UL)))
+
+/// Starts Timer1. Called once from init().
+void timer_init(void);
+
+/// Current tick count.
+uint16_t timer_now(void);
+
+/// Busy waits until `ticks` have passed since `start`.
+void timer_wait_since(uint16_t start, uint16_t ticks);
+
+/// 32 bit tick count.
+uint32_t timer_now32(void);
+
+/// Counts Timer1 overflows. Called from the ISR.
+void timer_service(void);
+
+#endif
@@ -0,0 +1,107 @@
+#ifdef TRACE
+
+#include <xc.h>
+
+#include "comlib.h"
+#include "timer.h"
+#include "trace.h"
+
+struct trace_ev {
+    uint16_t ts;
+    uint8_t id;
+    uint8_t arg;
+};
+
+static struct trace_ev ring[TRACE_ENTRIES];
+// Next entry written, entries held (saturates at TRACE_ENTRIES)
+static uint8_t head = 0;
+static uint8_t count = 0;
+// Overflows not yet recorded
+static uint8_t wraps = 0;
+// Something was recorded since the last overflow
+static bool dirty = false;
+// Set while the ring is being dumped
+static bool frozen = false;
+
+static void put(uint8_t id, uint8_t arg)
+{
+    struct trace_ev *ev = &ring[head];
+
+    ev->ts = timer_now();
+    ev->id = id;
+    ev->arg = arg;
+    head = (head + 1) & (TRACE_ENTRIES - 1);
+    if (count < TRACE_ENTRIES) {
+        count++;
+    }
+}
+
+void trace_event(uint8_t id, uint8_t arg)
+{
+    unsigned char gie = INTCONbits.GIE;
+
+    if (frozen) {
+        return;
+    }
+    // Also called from the ISR, which may itself be recording
+    INTCONbits.GIE = 0;
+    // Count an overflow the ISR hasn't got to yet before stamping
+    timer_service();
+    if (wraps) {
+        put(TRACE_WRAP, wraps);
+        wraps = 0;
+    }
+    put(id, arg);
+    dirty = true;
+    INTCONbits.GIE = gie;
+}
+
+void trace_wrap(void)
+{
+    if (wraps < 0xFF) {
+        wraps++;
+    }
+    if (dirty && !frozen) {
+        put(TRACE_WRAP, wraps);
+        wraps = 0;
+        dirty = false;
+    }
+}
+
+static uint8_t dump_source(void *ctx, uint16_t idx)
+{
+    const struct trace_ev *ev =
+        &ring[(uint8_t)(*(uint8_t *)ctx + idx / 4) & (TRACE_ENTRIES - 1)];
+
+    switch (idx & 3) {
+    case 0:
+        return ev->ts & 0xFF;
+    case 1:
+        return ev->ts >> 8;
+    case 2:
+        return ev->id;
+    default:
+        return ev->arg;
+    }
+}
+
+void trace_dump(void)
+{
+    uint8_t start;
+
+    frozen = true;
+    start = (head - count) & (TRACE_ENTRIES - 1);
+    printf("TRACE %u", count);
+    com_stream_hex((uint16_t)count * 4, dump_source, &start);
+    com_println("");
+
+    INTCONbits.GIE = 0;
+    head = 0;
+    count = 0;
+    wraps = 0;
+    dirty = false;
+    frozen = false;
+    INTCONbits.GIE = 1;
+}
+
+#endif
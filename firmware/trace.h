@@ -0,0 +1,67 @@
+/*
+Event trace ring
+
+A RAM ring of 4 byte events: Timer1 timestamp (u16, instruction cycles),
+event id, one byte of argument. Recording is a handful of stores, so unlike
+DEBUG() printing it doesn't disturb the timing being looked at. The 'Y'
+command freezes the ring, streams it to the host oldest first, then clears
+it. py/otl866/trace.py turns a dump into a timeline.
+
+Timestamps wrap every ~5.4ms. A TRACE_WRAP event carrying the number of
+Timer1 overflows since the previous one is recorded at the first overflow
+after any event, or ahead of the next event after a quiet spell.
+
+Build with TRACE defined (cmake -DTL866_TRACE=ON) to enable, otherwise
+TRACE_EV() compiles to nothing.
+*/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+// Must be a power of 2
+#define TRACE_ENTRIES 128
+
+// arg: Timer1 overflows since the last TRACE_WRAP (saturates at 255)
+#define TRACE_WRAP 0x01
+// arg: command letter, TRACE_CMD_END has none (prompt printed)
+#define TRACE_CMD     0x02
+#define TRACE_CMD_END 0x03
+// arg: binary op
+#define TRACE_FRAME     0x04
+#define TRACE_FRAME_END 0x05
+// arg: packet length
+#define TRACE_EP2_IN 0x06
+#define TRACE_EP3_IN 0x07
+// Rail output enables, no arg
+#define TRACE_VPP_EN  0x08
+#define TRACE_VPP_DIS 0x09
+#define TRACE_VDD_EN  0x0A
+#define TRACE_VDD_DIS 0x0B
+// arg: VID setting
+#define TRACE_VPP_VAL 0x0C
+#define TRACE_VDD_VAL 0x0D
+// + latch number, arg: value
+#define TRACE_LATCH 0x10
+// + zif_bits_t index, arg: new value. Only changed bytes are recorded
+#define TRACE_ZIF_WRITE 0x20
+#define TRACE_ZIF_DIR   0x28
+
+#ifdef TRACE
+
+#define TRACE_EV(id, arg) trace_event(id, arg)
+
+void trace_event(uint8_t id, uint8_t arg);
+// Timer1 overflow, from timer_service()
+void trace_wrap(void);
+// Stream the ring as a "TRACE n" line of hex bytes, then clear it
+void trace_dump(void);
+
+#else
+
+#define TRACE_EV(id, arg)
+
+#endif
+
+#endif
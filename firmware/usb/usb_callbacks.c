@@ -2,6 +2,7 @@
 #include "usb_ch9.h"
 #include "usb_cdc.h"
 #include "usb_config.h"
+#include "../comlib.h"
 
 int8_t app_send_encapsulated_command(uint8_t interface, uint16_t length)
 {
@@ -87,4 +88,14 @@ int8_t app_unknown_setup_request_callback(const struct setup_packet *setup)
 int16_t app_unknown_get_descriptor_callback(const struct setup_packet *pkt, const void **descriptor)
 {
     return -1;
-}
\ No newline at end of file
+}
+
+void app_in_transaction_callback(uint8_t endpoint)
+{
+    com_in_complete(endpoint);
+}
+
+void app_start_of_frame_callback(void)
+{
+    com_sof();
+}
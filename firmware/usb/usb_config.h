@@ -28,19 +28,24 @@
    BOTH IN and OUT endpoints for endpoint numbers (besides zero) up to the
    value specified.  For example, setting NUM_ENDPOINT_NUMBERS to 2 will
    activate endpoints EP 1 IN, EP 1 OUT, EP 2 IN, EP 2 OUT.  */
-#define NUM_ENDPOINT_NUMBERS 2
+#define NUM_ENDPOINT_NUMBERS 3
 
 /* Only 8, 16, 32 and 64 are supported for endpoint zero length. */
 #define EP_0_LEN 8
 
 #define EP_1_OUT_LEN 1
-#define EP_1_IN_LEN 10 /* May need to be longer, depending
+#define EP_1_IN_LEN 16 /* May need to be longer, depending
                         * on the notifications you support. */
  /* The code in the demo app assumes that EP2 IN and OUT are the same length */
 #define EP_2_LEN 64
 #define EP_2_OUT_LEN EP_2_LEN
 #define EP_2_IN_LEN EP_2_LEN
 
+/* Vendor class bulk interface (see comlib.h) */
+#define EP_3_LEN 64
+#define EP_3_OUT_LEN EP_3_LEN
+#define EP_3_IN_LEN EP_3_LEN
+
 #define NUMBER_OF_CONFIGURATIONS 1
 
 /* Ping-pong buffering mode. Valid values are:
@@ -53,7 +58,8 @@
 	/* PIC32MX only supports PPB_ALL */
 	#define PPB_MODE PPB_ALL
 #else
-	#define PPB_MODE PPB_NONE
+	/* EP2 IN streams from both buffers, see com_stream() */
+	#define PPB_MODE PPB_EPN_ONLY
 #endif
 
 /* Comment the following line to use polling USB operation. When using polling,
@@ -81,6 +87,10 @@
 // Actually these are required for CDC on windows. -- cnomad
 #define UNKNOWN_SETUP_REQUEST_CALLBACK app_unknown_setup_request_callback
 #define UNKNOWN_GET_DESCRIPTOR_CALLBACK app_unknown_get_descriptor_callback
+// Paces progress notifications on EP1 IN
+#define START_OF_FRAME_CALLBACK app_start_of_frame_callback
+// Drains the comlib output ring
+#define IN_TRANSACTION_COMPLETE_CALLBACK app_in_transaction_callback
 
 /* CDC Configuration functions. See usb_cdc.h for documentation. */
 #define CDC_SEND_ENCAPSULATED_COMMAND_CALLBACK app_send_encapsulated_command
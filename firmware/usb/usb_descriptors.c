@@ -70,6 +70,10 @@ struct configuration_1_packet {
 	struct endpoint_descriptor       data_ep_in;
 	struct endpoint_descriptor       data_ep_out;
 
+	/* Vendor Bulk Interface */
+	struct interface_descriptor      bulk_interface;
+	struct endpoint_descriptor       bulk_ep_in;
+	struct endpoint_descriptor       bulk_ep_out;
 };
 
 
@@ -115,7 +119,7 @@ static const ROMPTR struct configuration_1_packet configuration_1 =
 	sizeof(struct configuration_descriptor),
 	DESC_CONFIGURATION,
 	sizeof(configuration_1), // wTotalLength (length of the whole packet)
-	2, // bNumInterfaces
+	3, // bNumInterfaces
 	1, // bConfigurationValue
 	0, // iConfiguration (index of string descriptor)
 	0b10000000,
@@ -216,6 +220,40 @@ static const ROMPTR struct configuration_1_packet configuration_1 =
 	EP_2_OUT_LEN, // wMaxPacketSize
 	1, // bInterval in ms.
 	},
+
+	/* Vendor Bulk Interface. No class driver binds to it, so the host
+	 * reaches it with libusb and binary frames skip the tty layer. */
+	{
+	sizeof(struct interface_descriptor), // bLength;
+	DESC_INTERFACE,
+	0x2, // InterfaceNumber
+	0x0, // AlternateSetting
+	0x2, // bNumEndpoints
+	0xFF, // bInterfaceClass (vendor specific)
+	0x00, // bInterfaceSubclass
+	0x00, // bInterfaceProtocol
+	5, // iInterface
+	},
+
+	/* Vendor Bulk IN Endpoint (Endpoint 3 IN) */
+	{
+	sizeof(struct endpoint_descriptor),
+	DESC_ENDPOINT,
+	0x03 | 0x80, // endpoint #3 0x80=IN
+	EP_BULK, // bmAttributes
+	EP_3_IN_LEN, // wMaxPacketSize
+	1, // bInterval in ms.
+	},
+
+	/* Vendor Bulk OUT Endpoint (Endpoint 3 OUT) */
+	{
+	sizeof(struct endpoint_descriptor),
+	DESC_ENDPOINT,
+	0x03 /*| 0x00*/, // endpoint #3 0x00=OUT
+	EP_BULK, // bmAttributes
+	EP_3_OUT_LEN, // wMaxPacketSize
+	1, // bInterval in ms.
+	},
 };
 
 /* String Descriptors
@@ -255,6 +293,12 @@ static const ROMPTR struct {uint8_t bLength;uint8_t bDescriptorType; uint16_t ch
 };
 
 
+static const ROMPTR struct {uint8_t bLength;uint8_t bDescriptorType; uint16_t chars[15]; } bulk_interface_string = {
+	sizeof(bulk_interface_string),
+	DESC_STRING,
+	{'O','p','e','n','-','T','L','8','6','6',' ','B','u','l','k'}
+};
+
 
 /* Get String function
  *
@@ -284,6 +328,9 @@ int16_t usb_application_get_string(uint8_t string_number, const void **ptr)
 	case 4:
 		*ptr = &cdc_interface_string;
 		return sizeof(cdc_interface_string);
+	case 5:
+		*ptr = &bulk_interface_string;
+		return sizeof(bulk_interface_string);
 	default:
 		return -1;
 	}
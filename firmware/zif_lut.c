@@ -0,0 +1,63 @@
+#include "zif_lut.h"
+
+// Expand f(v, bank) for v = 0x00 through 0xFF
+#define ZIF_LUT16(f, bank, h)                                                  \
+    f(0x##h##0, bank), f(0x##h##1, bank), f(0x##h##2, bank),                   \
+        f(0x##h##3, bank), f(0x##h##4, bank), f(0x##h##5, bank),               \
+        f(0x##h##6, bank), f(0x##h##7, bank), f(0x##h##8, bank),               \
+        f(0x##h##9, bank), f(0x##h##A, bank), f(0x##h##B, bank),               \
+        f(0x##h##C, bank), f(0x##h##D, bank), f(0x##h##E, bank),               \
+        f(0x##h##F, bank)
+#define ZIF_LUT256(f, bank)                                                    \
+    {                                                                          \
+        ZIF_LUT16(f, bank, 0), ZIF_LUT16(f, bank, 1), ZIF_LUT16(f, bank, 2),   \
+            ZIF_LUT16(f, bank, 3), ZIF_LUT16(f, bank, 4),                      \
+            ZIF_LUT16(f, bank, 5), ZIF_LUT16(f, bank, 6),                      \
+            ZIF_LUT16(f, bank, 7), ZIF_LUT16(f, bank, 8),                      \
+            ZIF_LUT16(f, bank, 9), ZIF_LUT16(f, bank, A),                      \
+            ZIF_LUT16(f, bank, B), ZIF_LUT16(f, bank, C),                      \
+            ZIF_LUT16(f, bank, D), ZIF_LUT16(f, bank, E),                      \
+            ZIF_LUT16(f, bank, F)                                              \
+    }
+
+/*
+Fail the build if the tables below stop covering every ZIF pin, ex: a pin
+was moved to a port that has no table for its ZIF byte.
+*/
+#define ZIF_LUT_ASSERT(name, cond) typedef char name[(cond) ? 1 : -1]
+
+ZIF_LUT_ASSERT(zif_lut_covers_z0,
+               (ZIF_REV0(0xFF, OFFS_C) | ZIF_REV0(0xFF, OFFS_J)) == 0xFF);
+ZIF_LUT_ASSERT(zif_lut_covers_z1,
+               (ZIF_REV1(0xFF, OFFS_D) | ZIF_REV1(0xFF, OFFS_G) |
+                ZIF_REV1(0xFF, OFFS_J)) == 0xFF);
+ZIF_LUT_ASSERT(zif_lut_covers_z2, ZIF_REV2(0xFF, OFFS_E) == 0xFF);
+ZIF_LUT_ASSERT(zif_lut_covers_z3,
+               (ZIF_REV3(0xFF, OFFS_D) | ZIF_REV3(0xFF, OFFS_G) |
+                ZIF_REV3(0xFF, OFFS_J)) == 0xFF);
+ZIF_LUT_ASSERT(zif_lut_covers_z4,
+               (ZIF_REV4(0xFF, OFFS_B) | ZIF_REV4(0xFF, OFFS_J)) == 0xFF);
+
+const unsigned char zif_lut_z0_c[256] = ZIF_LUT256(ZIF_FWD0, OFFS_C);
+const unsigned char zif_lut_z0_j[256] = ZIF_LUT256(ZIF_FWD0, OFFS_J);
+const unsigned char zif_lut_z1_d[256] = ZIF_LUT256(ZIF_FWD1, OFFS_D);
+const unsigned char zif_lut_z1_g[256] = ZIF_LUT256(ZIF_FWD1, OFFS_G);
+const unsigned char zif_lut_z1_j[256] = ZIF_LUT256(ZIF_FWD1, OFFS_J);
+const unsigned char zif_lut_z2_e[256] = ZIF_LUT256(ZIF_FWD2, OFFS_E);
+const unsigned char zif_lut_z3_d[256] = ZIF_LUT256(ZIF_FWD3, OFFS_D);
+const unsigned char zif_lut_z3_g[256] = ZIF_LUT256(ZIF_FWD3, OFFS_G);
+const unsigned char zif_lut_z3_j[256] = ZIF_LUT256(ZIF_FWD3, OFFS_J);
+const unsigned char zif_lut_z4_b[256] = ZIF_LUT256(ZIF_FWD4, OFFS_B);
+const unsigned char zif_lut_z4_j[256] = ZIF_LUT256(ZIF_FWD4, OFFS_J);
+
+const unsigned char zif_lut_c_z0[256] = ZIF_LUT256(ZIF_REV0, OFFS_C);
+const unsigned char zif_lut_j_z0[256] = ZIF_LUT256(ZIF_REV0, OFFS_J);
+const unsigned char zif_lut_d_z1[256] = ZIF_LUT256(ZIF_REV1, OFFS_D);
+const unsigned char zif_lut_g_z1[256] = ZIF_LUT256(ZIF_REV1, OFFS_G);
+const unsigned char zif_lut_j_z1[256] = ZIF_LUT256(ZIF_REV1, OFFS_J);
+const unsigned char zif_lut_e_z2[256] = ZIF_LUT256(ZIF_REV2, OFFS_E);
+const unsigned char zif_lut_d_z3[256] = ZIF_LUT256(ZIF_REV3, OFFS_D);
+const unsigned char zif_lut_g_z3[256] = ZIF_LUT256(ZIF_REV3, OFFS_G);
+const unsigned char zif_lut_j_z3[256] = ZIF_LUT256(ZIF_REV3, OFFS_J);
+const unsigned char zif_lut_b_z4[256] = ZIF_LUT256(ZIF_REV4, OFFS_B);
+const unsigned char zif_lut_j_z4[256] = ZIF_LUT256(ZIF_REV4, OFFS_J);
@@ -0,0 +1,167 @@
+/*
+ * ZIF pin <=> PIC port translation tables
+ *
+ * The ZIF to port mapping below is the single source for zif2port[] and
+ * zif2pin[] in io.c and the byte-sliced lookup tables in zif_lut.c. The tables are
+ * expanded by the preprocessor, so editing a pin here regenerates all of
+ * them at build time.
+ *
+ * Forward tables take one ZIF byte (8 pins) and return the bits it sets in
+ * one PIC port. Reverse tables take one PIC port byte and return the bits it
+ * sets in one ZIF byte. Only (ZIF byte, port) pairs that share pins get a
+ * table, so a full 40 pin conversion is 11 lookups.
+ */
+
+#ifndef ZIF_LUT_H
+#define ZIF_LUT_H
+
+// port_bits_t index of each PIC I/O bank
+#define OFFS_A 0
+#define OFFS_B 1
+#define OFFS_C 2
+#define OFFS_D 3
+#define OFFS_E 4
+#define OFFS_F 5
+#define OFFS_G 6
+#define OFFS_H 7
+#define OFFS_J 8
+
+// Pack a bank / bit pair into one constant
+#define ZIF_PORT_PIN(bank, bit) ((bank) * 8 + (bit))
+#define ZIF_BANK(pp)            ((pp) >> 3)
+#define ZIF_BIT(pp)             ((pp) & 7)
+
+// 1-8
+#define ZIF_PIN_1 ZIF_PORT_PIN(OFFS_C, 5)
+#define ZIF_PIN_2 ZIF_PORT_PIN(OFFS_C, 4)
+#define ZIF_PIN_3 ZIF_PORT_PIN(OFFS_C, 3)
+#define ZIF_PIN_4 ZIF_PORT_PIN(OFFS_C, 2)
+#define ZIF_PIN_5 ZIF_PORT_PIN(OFFS_J, 7)
+#define ZIF_PIN_6 ZIF_PORT_PIN(OFFS_J, 6)
+#define ZIF_PIN_7 ZIF_PORT_PIN(OFFS_C, 6)
+#define ZIF_PIN_8 ZIF_PORT_PIN(OFFS_C, 7)
+
+// 9-16
+#define ZIF_PIN_9  ZIF_PORT_PIN(OFFS_J, 4)
+#define ZIF_PIN_10 ZIF_PORT_PIN(OFFS_J, 5)
+#define ZIF_PIN_11 ZIF_PORT_PIN(OFFS_G, 3)
+#define ZIF_PIN_12 ZIF_PORT_PIN(OFFS_G, 2)
+#define ZIF_PIN_13 ZIF_PORT_PIN(OFFS_D, 0)
+#define ZIF_PIN_14 ZIF_PORT_PIN(OFFS_D, 1)
+#define ZIF_PIN_15 ZIF_PORT_PIN(OFFS_D, 2)
+#define ZIF_PIN_16 ZIF_PORT_PIN(OFFS_G, 1)
+
+// 17-24
+#define ZIF_PIN_17 ZIF_PORT_PIN(OFFS_E, 0)
+#define ZIF_PIN_18 ZIF_PORT_PIN(OFFS_E, 7)
+#define ZIF_PIN_19 ZIF_PORT_PIN(OFFS_E, 2)
+#define ZIF_PIN_20 ZIF_PORT_PIN(OFFS_E, 3)
+#define ZIF_PIN_21 ZIF_PORT_PIN(OFFS_E, 4)
+#define ZIF_PIN_22 ZIF_PORT_PIN(OFFS_E, 5)
+#define ZIF_PIN_23 ZIF_PORT_PIN(OFFS_E, 6)
+#define ZIF_PIN_24 ZIF_PORT_PIN(OFFS_E, 1)
+
+// 25-32
+#define ZIF_PIN_25 ZIF_PORT_PIN(OFFS_D, 3)
+#define ZIF_PIN_26 ZIF_PORT_PIN(OFFS_D, 4)
+#define ZIF_PIN_27 ZIF_PORT_PIN(OFFS_D, 5)
+#define ZIF_PIN_28 ZIF_PORT_PIN(OFFS_D, 6)
+#define ZIF_PIN_29 ZIF_PORT_PIN(OFFS_D, 7)
+#define ZIF_PIN_30 ZIF_PORT_PIN(OFFS_G, 0)
+#define ZIF_PIN_31 ZIF_PORT_PIN(OFFS_J, 0)
+#define ZIF_PIN_32 ZIF_PORT_PIN(OFFS_J, 1)
+
+// 33-40
+#define ZIF_PIN_33 ZIF_PORT_PIN(OFFS_J, 2)
+#define ZIF_PIN_34 ZIF_PORT_PIN(OFFS_J, 3)
+#define ZIF_PIN_35 ZIF_PORT_PIN(OFFS_B, 2)
+#define ZIF_PIN_36 ZIF_PORT_PIN(OFFS_B, 3)
+#define ZIF_PIN_37 ZIF_PORT_PIN(OFFS_B, 4)
+#define ZIF_PIN_38 ZIF_PORT_PIN(OFFS_B, 5)
+#define ZIF_PIN_39 ZIF_PORT_PIN(OFFS_B, 6)
+#define ZIF_PIN_40 ZIF_PORT_PIN(OFFS_B, 7)
+
+// port_info_t initializer for ZIF pin n
+#define ZIF2PORT(n) {ZIF_BANK(ZIF_PIN_##n), ZIF_BIT(ZIF_PIN_##n)}
+// port_pin_t initializer for ZIF pin n
+#define ZIF2PIN(n) {ZIF_BANK(ZIF_PIN_##n), 1 << ZIF_BIT(ZIF_PIN_##n)}
+
+/*
+Bit k of ZIF byte value v is pin n. Contribute it to port `bank` (forward)
+or take it from port byte v of `bank` (reverse).
+*/
+#define ZIF_FWD_BIT(v, k, n, bank)                                             \
+    ((ZIF_BANK(ZIF_PIN_##n) == (bank))                                         \
+         ? ((((v) >> (k)) & 1) << ZIF_BIT(ZIF_PIN_##n))                        \
+         : 0)
+#define ZIF_REV_BIT(v, k, n, bank)                                             \
+    ((ZIF_BANK(ZIF_PIN_##n) == (bank))                                         \
+         ? ((((v) >> ZIF_BIT(ZIF_PIN_##n)) & 1) << (k))                        \
+         : 0)
+
+#define ZIF_BYTE_MAP(m, v, bank, p0, p1, p2, p3, p4, p5, p6, p7)               \
+    (m(v, 0, p0, bank) | m(v, 1, p1, bank) | m(v, 2, p2, bank) |               \
+     m(v, 3, p3, bank) | m(v, 4, p4, bank) | m(v, 5, p5, bank) |               \
+     m(v, 6, p6, bank) | m(v, 7, p7, bank))
+
+// ZIF byte i value v => bits of port `bank`
+#define ZIF_FWD0(v, bank)                                                      \
+    ZIF_BYTE_MAP(ZIF_FWD_BIT, v, bank, 1, 2, 3, 4, 5, 6, 7, 8)
+#define ZIF_FWD1(v, bank)                                                      \
+    ZIF_BYTE_MAP(ZIF_FWD_BIT, v, bank, 9, 10, 11, 12, 13, 14, 15, 16)
+#define ZIF_FWD2(v, bank)                                                      \
+    ZIF_BYTE_MAP(ZIF_FWD_BIT, v, bank, 17, 18, 19, 20, 21, 22, 23, 24)
+#define ZIF_FWD3(v, bank)                                                      \
+    ZIF_BYTE_MAP(ZIF_FWD_BIT, v, bank, 25, 26, 27, 28, 29, 30, 31, 32)
+#define ZIF_FWD4(v, bank)                                                      \
+    ZIF_BYTE_MAP(ZIF_FWD_BIT, v, bank, 33, 34, 35, 36, 37, 38, 39, 40)
+
+// Port `bank` value v => bits of ZIF byte i
+#define ZIF_REV0(v, bank)                                                      \
+    ZIF_BYTE_MAP(ZIF_REV_BIT, v, bank, 1, 2, 3, 4, 5, 6, 7, 8)
+#define ZIF_REV1(v, bank)                                                      \
+    ZIF_BYTE_MAP(ZIF_REV_BIT, v, bank, 9, 10, 11, 12, 13, 14, 15, 16)
+#define ZIF_REV2(v, bank)                                                      \
+    ZIF_BYTE_MAP(ZIF_REV_BIT, v, bank, 17, 18, 19, 20, 21, 22, 23, 24)
+#define ZIF_REV3(v, bank)                                                      \
+    ZIF_BYTE_MAP(ZIF_REV_BIT, v, bank, 25, 26, 27, 28, 29, 30, 31, 32)
+#define ZIF_REV4(v, bank)                                                      \
+    ZIF_BYTE_MAP(ZIF_REV_BIT, v, bank, 33, 34, 35, 36, 37, 38, 39, 40)
+
+// Port bits owned by the ZIF socket, per bank
+#define ZIF_MASK_B ZIF_FWD4(0xFF, OFFS_B)
+#define ZIF_MASK_C ZIF_FWD0(0xFF, OFFS_C)
+#define ZIF_MASK_D (ZIF_FWD1(0xFF, OFFS_D) | ZIF_FWD3(0xFF, OFFS_D))
+#define ZIF_MASK_E ZIF_FWD2(0xFF, OFFS_E)
+#define ZIF_MASK_G (ZIF_FWD1(0xFF, OFFS_G) | ZIF_FWD3(0xFF, OFFS_G))
+#define ZIF_MASK_J                                                             \
+    (ZIF_FWD0(0xFF, OFFS_J) | ZIF_FWD1(0xFF, OFFS_J) |                         \
+     ZIF_FWD3(0xFF, OFFS_J) | ZIF_FWD4(0xFF, OFFS_J))
+
+// Forward: ZIF byte => port bits
+extern const unsigned char zif_lut_z0_c[256];
+extern const unsigned char zif_lut_z0_j[256];
+extern const unsigned char zif_lut_z1_d[256];
+extern const unsigned char zif_lut_z1_g[256];
+extern const unsigned char zif_lut_z1_j[256];
+extern const unsigned char zif_lut_z2_e[256];
+extern const unsigned char zif_lut_z3_d[256];
+extern const unsigned char zif_lut_z3_g[256];
+extern const unsigned char zif_lut_z3_j[256];
+extern const unsigned char zif_lut_z4_b[256];
+extern const unsigned char zif_lut_z4_j[256];
+
+// Reverse: port bits => ZIF byte
+extern const unsigned char zif_lut_c_z0[256];
+extern const unsigned char zif_lut_j_z0[256];
+extern const unsigned char zif_lut_d_z1[256];
+extern const unsigned char zif_lut_g_z1[256];
+extern const unsigned char zif_lut_j_z1[256];
+extern const unsigned char zif_lut_e_z2[256];
+extern const unsigned char zif_lut_d_z3[256];
+extern const unsigned char zif_lut_g_z3[256];
+extern const unsigned char zif_lut_j_z3[256];
+extern const unsigned char zif_lut_b_z4[256];
+extern const unsigned char zif_lut_j_z4[256];
+
+#endif
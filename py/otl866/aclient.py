@@ -38,6 +38,69 @@ VDD_PINS0 = set([x - 1 for x in VDD_PINS])
 GND_PINS0 = set([x - 1 for x in GND_PINS])
 
 
+# Binary frames, see firmware/comlib.h
+FRAME_ESC = 0xA5
+FRAME_MAX = 64
+FRAME_STATUS = (FRAME_OK, FRAME_E_CRC, FRAME_E_LEN, FRAME_E_OP, FRAME_E_ARG,
+                FRAME_E_CMD) = range(6)
+# Write stream data and credit frames
+FRAME_OP_DATA = '>'
+FRAME_OP_CREDIT = '<'
+# Session options
+FRAME_OP_OPTS = '='
+FRAME_F_RLE = 0x01
+
+
+def frame_crc(buf):
+    """CRC-16/CCITT-FALSE"""
+    return binascii.crc_hqx(buf, 0xFFFF)
+
+
+def rle_encode(buf):
+    """
+    Frame RLE: two equal bytes in a row are followed by a count of further
+    repeats (0-255)
+    """
+    ret = bytearray()
+    i = 0
+    while i < len(buf):
+        b = buf[i]
+        if i + 1 < len(buf) and buf[i + 1] == b:
+            run = 2
+            while i + run < len(buf) and buf[i + run] == b and run < 257:
+                run += 1
+            ret += bytes([b, b, run - 2])
+            i += run
+        else:
+            ret.append(b)
+            i += 1
+    return bytes(ret)
+
+
+def rle_decode(read, n):
+    """
+    Decode n bytes, pulling coded bytes from read(count)
+    Returns (decoded, coded)
+    """
+    ret = bytearray()
+    coded = bytearray()
+    prev = None
+    while len(ret) < n:
+        b = read(1)[0]
+        coded.append(b)
+        ret.append(b)
+        if b == prev:
+            c = read(1)[0]
+            coded.append(c)
+            ret += bytes([b]) * c
+            prev = None
+        else:
+            prev = b
+    if len(ret) != n:
+        raise BadCommand("RLE run past end of frame")
+    return bytes(ret), bytes(coded)
+
+
 class NoSuchLine(Exception):
     pass
 
@@ -150,8 +213,16 @@ class AClient:
         self.e.flush()
         self.flushInput()
 
+        self.frame_seq = 0
+        # Negotiated FRAME_F_* options, None until the first frame
+        self.frame_flags = None
         self.assert_ver()
 
+    def close(self):
+        '''Release the serial port'''
+        # Closes self.ser too
+        self.e.close()
+
     def flushInput(self):
         # Try to get rid of previous command in progress, if any
         tlast = time.time()
@@ -166,21 +237,16 @@ class AClient:
         self.e.expect(s, timeout=timeout)
         return self.e.before
 
-    def cmd(self, cmd, *args, reply=True, check=True):
-        '''Send raw command and get string result'''
+    def cmd_str(self, cmd, *args):
+        '''Format a command line'''
         cmd = str(cmd)
         if len(cmd) != 1:
             raise ValueError('Invalid cmd %s' % cmd)
-        strout = cmd + " " + ' '.join([str(arg) for arg in args]) + "\n"
-        (self.verbose or self.verbose_cmd) and print(
-            "cmd out: %s" % strout.strip())
-        self.e.write(strout)
-        self.e.flush()
+        return cmd + " " + ' '.join([str(arg) for arg in args]) + "\n"
 
-        if not reply:
-            return None
-
-        ret = self.expect('CMD>')
+    def cmd_ret(self, strout, timeout=0.5):
+        '''Get the string result of a command already sent'''
+        ret = self.expect('CMD>', timeout=timeout)
         # most verbose => low level command trace
         # too verbose for that
         self.verbose_cmd and print('cmd ret: chars %u' % (len(ret), ))
@@ -190,6 +256,128 @@ class AClient:
                              (strout.strip(), outterse))
         return ret
 
+    def cmd(self, cmd, *args, reply=True, check=True, timeout=0.5):
+        '''Send raw command and get string result'''
+        strout = self.cmd_str(cmd, *args)
+        (self.verbose or self.verbose_cmd) and print(
+            "cmd out: %s" % strout.strip())
+        self.e.write(strout)
+        self.e.flush()
+
+        if not reply:
+            return None
+
+        return self.cmd_ret(strout, timeout=timeout)
+
+    def cmds(self, cmds, timeout=0.5):
+        '''
+        Send a list of (cmd, arg, ...) tuples back to back and return the
+        list of string results
+        The firmware queues the lines, so there is no round trip per command
+        '''
+        strouts = [self.cmd_str(*cmd) for cmd in cmds]
+        (self.verbose or self.verbose_cmd) and print(
+            "cmds out: %u commands" % len(strouts))
+        self.e.write(''.join(strouts))
+        self.e.flush()
+        return [self.cmd_ret(strout, timeout=timeout) for strout in strouts]
+
+    def read_exact(self, n, timeout):
+        ret = bytearray()
+        tend = time.time() + timeout
+        while len(ret) < n:
+            buf = self.ser.read(n - len(ret))
+            if buf:
+                ret += buf
+            elif time.time() > tend:
+                raise Timeout("Timed out reading %u bytes" % n)
+        return bytes(ret)
+
+    def frame_send(self, op, payload=b''):
+        '''Send a binary command frame, returns its sequence number'''
+        payload = bytes(payload)
+        if len(payload) > FRAME_MAX:
+            raise ValueError("Payload too large: %u" % len(payload))
+        payload_len = len(payload)
+        if self.frame_rle(op):
+            payload = rle_encode(payload)
+        seq = self.frame_seq
+        self.frame_seq = (seq + 1) & 0xFF
+        body = struct.pack('<HBB', payload_len, ord(op), seq) + payload
+        self.verbose_cmd and print("frame out: %s %s" % (op, payload.hex()))
+        self.ser.write(
+            bytes([FRAME_ESC]) + body + struct.pack('<H', frame_crc(body)))
+        return seq
+
+    def frame_recv(self, op, seq, timeout=2.0):
+        '''Read the reply to frame op / seq, returns its data'''
+        # Skip any text ahead of the reply (ex: rest of the prompt)
+        while self.read_exact(1, timeout)[0] != FRAME_ESC:
+            pass
+        hdr = self.read_exact(4, timeout)
+        rlen, rop, rseq = struct.unpack('<HBB', hdr)
+        if self.frame_rle(op):
+            data, coded = rle_decode(lambda n: self.read_exact(n, timeout),
+                                     rlen)
+        else:
+            data = coded = self.read_exact(rlen, timeout)
+        crc, = struct.unpack('<H', self.read_exact(2, timeout))
+        if crc != frame_crc(hdr + coded):
+            raise BadCommand("Frame %s: bad reply CRC" % op)
+        if rop != ord(op) or rseq != seq:
+            raise BadCommand("Frame %s: reply out of sequence" % op)
+        if rlen < 1 or data[0] != FRAME_OK:
+            raise BadCommand("Frame %s: status %u" % (op, data[0]))
+        return data[1:]
+
+    def frame_rle(self, op):
+        if op == FRAME_OP_OPTS:
+            return False
+        if self.frame_flags is None:
+            self.frame_session()
+        return bool(self.frame_flags & FRAME_F_RLE)
+
+    def frame_session(self, rle=True):
+        '''
+        Pick frame options for this session, returns the flags in effect
+        Older firmware without options runs uncompressed
+        '''
+        self.frame_flags = 0
+        want = FRAME_F_RLE if rle else 0
+        try:
+            self.frame_flags = self.frame(FRAME_OP_OPTS, bytes([want]))[0]
+        except BadCommand:
+            pass
+        return self.frame_flags
+
+    def frame(self, op, payload=b'', timeout=2.0):
+        '''
+        Send a binary command frame and return the reply data
+        op is the text command letter, payload raw bytes
+        '''
+        seq = self.frame_send(op, payload)
+        self.ser.flush()
+        return self.frame_recv(op, seq, timeout)
+
+    def frame_stream(self, op, payload, data, timeout=2.0):
+        '''
+        Run a write stream op (ex: AT89 'W'), sending data as fast as the
+        device hands back credit for it
+        '''
+        window, = struct.unpack('<H', self.frame(op, payload, timeout))
+        sent = 0
+        done = 0
+        while done < len(data):
+            while sent < len(data) and sent - done < window:
+                n = min(FRAME_MAX, len(data) - sent, window - (sent - done))
+                self.frame_send(FRAME_OP_DATA, data[sent:sent + n])
+                sent += n
+            self.ser.flush()
+            credit, = struct.unpack('<H', self.frame_recv(FRAME_OP_CREDIT, 0,
+                                                          timeout))
+            # Count is u16 and wraps
+            done += (credit - done) & 0xFFFF
+
     def match_line(self, a_re, res):
         # print(len(self.e.before), len(self.e.after), len(res))
         lines = res.split('\n')
@@ -17,6 +17,7 @@ addr, range in hex
 """
 
 import binascii
+import struct
 
 from otl866 import aclient
 import binascii
@@ -47,10 +48,22 @@ class AT89(aclient.AClient):
         hexstr = hexstr.replace(" ", "")
         return binascii.unhexlify(hexstr)
 
+    def read_frame(self, addr, bytes):
+        """Read using the binary protocol"""
+        return self.frame('r',
+                          struct.pack('<HH', addr, bytes),
+                          timeout=2.0 + bytes / 1000)
+
     def write(self, addr, data):
         assert 0x00 <= data <= 0xFF
         self.cmd('w', "%04X" % addr, "%02X" % data)
 
+    def write_stream(self, addr, data):
+        """Write a block, credit flow controlled"""
+        self.frame_stream('W', struct.pack('<HH', addr, len(data)),
+                          bytes(data),
+                          timeout=2.0 + len(data) / 100)
+
     def read_sf(self, addr, bytes):
         res = self.cmd('R', "%04X" % addr, "%04X" % bytes)
         hexstr = self.match_line(r"[0-9A-F]{3} (.*)", res).group(1)
@@ -120,6 +133,14 @@ class AT89(aclient.AClient):
         res = self.match_line(r"Result: (.*)", self.cmd('B')).group(1)
         return res == "blank"
 
+    def blank_frame(self):
+        """
+        Blank check using the binary protocol
+        Returns the first address not 0xFF, None if blank
+        """
+        addr, = struct.unpack('<H', self.frame('B', timeout=30.0))
+        return None if addr == 0x1000 else addr
+
     """
     def tests(self):
         self.cmd('T')
@@ -32,6 +32,10 @@ z val      I/O: set ZIF pins (ZIF_WRITE)
            LSB is ZIF pin 1
 Z          I/O: get ZIF pins (ZIF_READ)
            LSB is ZIF pin 1
+Pin program
+x off hex  Load program bytes at offset
+           off 0 starts a new program
+X          Run program, reads print as hex lines
 Misc
 L val      LED on/off
            1 = on, 0 = off
@@ -41,7 +45,10 @@ i          Re-initialize
 b          Reset to bootloader
 '''
 
+import binascii
+
 from otl866 import aclient
+from otl866 import pinvm
 from otl866.aclient import VPPS, VDDS
 
 
@@ -55,6 +62,8 @@ class Bitbang(aclient.AClient):
     def __init__(self, *args, **kwargs):
         self.cache_check = True
         self.clear_cache()
+        # Firmware has the pin VM, None until has_pinvm() asks
+        self.pinvm_ok = None
         aclient.AClient.__init__(self, *args, **kwargs)
 
     def clear_cache(self):
@@ -155,6 +164,65 @@ class Bitbang(aclient.AClient):
             assert (ret & mask) == (self.io_w_cache & mask)
         return ret
 
+    def io_w_frame(self, val):
+        '''write ZIF pins, binary protocol'''
+        self.assert_zif(val)
+        self.frame('z', val.to_bytes(5, 'little'))
+        self.io_w_cache = val
+
+    def io_r_frame(self):
+        '''read ZIF pins, binary protocol'''
+        return int.from_bytes(self.frame('Z'), 'little')
+
+    def io_w_r(self, vals):
+        '''write then read ZIF pins for each of vals, pipelined'''
+        cmds = []
+        for val in vals:
+            self.assert_zif(val)
+            cmds += [('z', self.zif_str(val)), ('Z', )]
+        rets = self.cmds(cmds)
+        if vals:
+            self.io_w_cache = vals[-1]
+        return [self.result_zif(ret) for ret in rets[1::2]]
+
+    '''
+    Pin program
+    '''
+
+    def has_pinvm(self):
+        '''Firmware has the pin VM commands (x / X), probed once'''
+        if self.pinvm_ok is None:
+            try:
+                # An empty program, harmless to load
+                self.cmd('x', 0, '%02X' % pinvm.OP_END)
+                self.pinvm_ok = True
+            except aclient.BadCommand as e:
+                if "unknown command" not in str(e):
+                    raise
+                self.pinvm_ok = False
+        return self.pinvm_ok
+
+    def pinvm_load(self, prog):
+        '''Upload an assembled pinvm program'''
+        if len(prog) > pinvm.PROG_MAX:
+            raise ValueError("Program too large: %u bytes" % len(prog))
+        for off in range(0, len(prog), pinvm.CHUNK_MAX):
+            chunk = prog[off:off + pinvm.CHUNK_MAX]
+            self.cmd('x', off, binascii.hexlify(chunk).decode('ascii'))
+
+    def pinvm_run(self, timeout=10.0):
+        '''Run the loaded program and return its read output'''
+        ret = bytearray()
+        # First line is the command echo
+        for l in self.cmd('X', timeout=timeout).split('\n')[1:]:
+            l = l.strip()
+            if l:
+                ret += binascii.unhexlify(l)
+        # Pins were driven behind the caches' back
+        self.io_w_cache = None
+        self.io_tri_cache = None
+        return ret
+
     '''
     Misc
     '''
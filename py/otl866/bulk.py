@@ -0,0 +1,145 @@
+'''
+Binary frames over the vendor bulk interface (EP3)
+
+Same frames as AClient.frame(), but straight to the endpoints with pyusb
+instead of through the serial port, so there is no tty buffering and no
+console text to skip. The serial console stays usable alongside it.
+'''
+
+import struct
+import time
+import usb.core
+import usb.util
+
+from otl866 import aclient
+from otl866.aclient import BadCommand, Timeout
+from otl866.bootloader.driver import O_USB_VENDOR, O_USB_PRODUCT
+
+BULK_INTERFACE = 2
+BULK_EP_OUT = 0x03
+BULK_EP_IN = 0x83
+# Host read size, a multiple of the 64 byte packet size
+READ_SIZE = 4096
+
+
+class Bulk:
+    def __init__(self, device=None, verbose=False):
+        if device is None:
+            device = usb.core.find(idVendor=O_USB_VENDOR,
+                                   idProduct=O_USB_PRODUCT)
+            if device is None:
+                raise Exception("Failed to find an open-tl866 device")
+        self.device = device
+        self.verbose = verbose
+        self.seq = 0
+        # Shared with the serial console, the last negotiation wins
+        self.frame_flags = None
+        usb.util.claim_interface(self.device, BULK_INTERFACE)
+        self.buf = bytearray()
+
+    def close(self):
+        usb.util.release_interface(self.device, BULK_INTERFACE)
+        usb.util.dispose_resources(self.device)
+
+    def read_reply(self, timeout):
+        '''Read up to the short packet ending a reply'''
+        tend = time.time() + timeout
+        while True:
+            try:
+                chunk = self.device.read(BULK_EP_IN, READ_SIZE,
+                                         max(1, int((tend - time.time()) *
+                                                    1000)))
+            except usb.core.USBTimeoutError:
+                raise Timeout("Timed out waiting for bulk reply")
+            self.buf += chunk
+            if len(chunk) < READ_SIZE:
+                break
+
+    def frame_send(self, op, payload=b'', timeout=2.0):
+        '''Send a binary command frame, returns its sequence number'''
+        payload = bytes(payload)
+        if len(payload) > aclient.FRAME_MAX:
+            raise ValueError("Payload too large: %u" % len(payload))
+        payload_len = len(payload)
+        if self.rle(op):
+            payload = aclient.rle_encode(payload)
+        seq = self.seq
+        self.seq = (seq + 1) & 0xFF
+        body = struct.pack('<HBB', payload_len, ord(op), seq) + payload
+        self.verbose and print("bulk out: %s %s" % (op, payload.hex()))
+        self.device.write(
+            BULK_EP_OUT,
+            bytes([aclient.FRAME_ESC]) + body +
+            struct.pack('<H', aclient.frame_crc(body)),
+            int(timeout * 1000))
+        return seq
+
+    def frame_recv(self, op, seq, timeout=2.0):
+        '''Read the reply to frame op / seq, returns its data'''
+        self.buf = bytearray()
+        self.read_reply(timeout)
+        if len(self.buf) < 7 or self.buf[0] != aclient.FRAME_ESC:
+            raise BadCommand("Frame %s: bad reply" % op)
+        rlen, rop, rseq = struct.unpack('<HBB', self.buf[1:5])
+        coded = bytes(self.buf[5:-2])
+        if self.rle(op):
+            pos = [0]
+
+            def read(n):
+                pos[0] += n
+                if pos[0] > len(coded):
+                    raise BadCommand("Frame %s: reply truncated" % op)
+                return coded[pos[0] - n:pos[0]]
+
+            data, coded = aclient.rle_decode(read, rlen)
+        else:
+            data = coded
+        if len(self.buf) != len(coded) + 7 or len(data) != rlen:
+            raise BadCommand("Frame %s: reply length mismatch" % op)
+        crc, = struct.unpack('<H', self.buf[-2:])
+        if crc != aclient.frame_crc(bytes(self.buf[1:5]) + coded):
+            raise BadCommand("Frame %s: bad reply CRC" % op)
+        if rop != ord(op) or rseq != seq:
+            raise BadCommand("Frame %s: reply out of sequence" % op)
+        if data[0] != aclient.FRAME_OK:
+            raise BadCommand("Frame %s: status %u" % (op, data[0]))
+        return data[1:]
+
+    def rle(self, op):
+        if op == aclient.FRAME_OP_OPTS:
+            return False
+        if self.frame_flags is None:
+            self.frame_session()
+        return bool(self.frame_flags & aclient.FRAME_F_RLE)
+
+    def frame_session(self, rle=True):
+        '''Same as AClient.frame_session()'''
+        self.frame_flags = 0
+        want = aclient.FRAME_F_RLE if rle else 0
+        try:
+            self.frame_flags = self.frame(aclient.FRAME_OP_OPTS,
+                                          bytes([want]))[0]
+        except BadCommand:
+            pass
+        return self.frame_flags
+
+    def frame(self, op, payload=b'', timeout=2.0):
+        '''Send a binary command frame and return the reply data'''
+        seq = self.frame_send(op, payload, timeout)
+        return self.frame_recv(op, seq, timeout)
+
+    def frame_stream(self, op, payload, data, timeout=2.0):
+        '''Same as AClient.frame_stream()'''
+        window, = struct.unpack('<H', self.frame(op, payload, timeout))
+        sent = 0
+        done = 0
+        while done < len(data):
+            while sent < len(data) and sent - done < window:
+                n = min(aclient.FRAME_MAX, len(data) - sent,
+                        window - (sent - done))
+                self.frame_send(aclient.FRAME_OP_DATA, data[sent:sent + n],
+                                timeout)
+                sent += n
+            credit, = struct.unpack(
+                '<H', self.frame_recv(aclient.FRAME_OP_CREDIT, 0, timeout))
+            done += (credit - done) & 0xFFFF
@@ -3,6 +3,7 @@
 import argparse
 
 import otl866.bootloader.cli
+import otl866.usbbench
 
 
 def main():
@@ -11,6 +12,7 @@ def main():
 
     subgroup = parser.add_subparsers()
     otl866.bootloader.cli.build_argparse(subgroup)
+    otl866.usbbench.build_argparse(subgroup)
 
     args = parser.parse_args()
 
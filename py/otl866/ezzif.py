@@ -0,0 +1,29 @@
+"""
+CMD> ?
+open-tl866 (ezzif)
+0      digital I/O test
+1      bus I/O test
+2      VPP sweep test
+3      VDD sweep test
+4      multiple voltage rail test
+5      no ground test
+P pins DIP package, 8 to 40 pins (default 28)
+d      debug status
+U      print and reset USB statistics
+b      reset to bootloader
+"""
+
+from otl866 import aclient
+
+
+class EZZIF(aclient.AClient):
+    APP = "ezzif"
+
+    def package(self, npins=None):
+        """
+        Select the DIP package ezzif pin numbers refer to, 8 to 40 pins.
+        Without npins only reads it back. Returns the package pin count.
+        Kept until changed, across commands.
+        """
+        payload = b'' if npins is None else bytes([npins])
+        return self.frame('P', payload)[0]
@@ -4,6 +4,7 @@ Bitbang memory utilities
 """
 
 from . import aclient
+from . import pinvm
 """
 DIP package at the top most part of the socket
 Provides a HAL for setting pins by number and some basic tristate and power setup
@@ -196,9 +197,30 @@ class DataBus:
         """Read val from bus"""
         return self.ez2data(self.pack.ez.io_r())
 
+    def read_all_pinvm(self):
+        """Read the whole bus with one on-device program"""
+        prog = pinvm.read_sweep(
+            [self.pack.pin_pack2zif[pin] for pin in self.addr_pins],
+            [self.pack.pin_pack2zif[pin] for pin in self.data_pins],
+            self.words())
+        bb = self.pack.ez.ez
+        bb.pinvm_load(prog)
+        ret = bb.pinvm_run()
+        if len(self.data_pins) > 8:
+            ret = bytearray(ret[0::2])
+        assert len(ret) == self.words(), len(ret)
+        return ret
+
     def read_all(self, verbose=None):
         if verbose is None:
             verbose = self.verbose
+        # Buses too wide for the pin VM, or firmware without it, take a
+        # command per word
+        if (len(self.addr_pins) <= pinvm.BUS_MAX and
+                len(self.data_pins) <= pinvm.BUS_MAX and
+                self.pack.ez.ez.has_pinvm()):
+            verbose and print("Reading %u words (pinvm)" % self.words())
+            return self.read_all_pinvm()
         ret = bytearray()
         verbose and print("Reading %u words" % self.words())
         for addr in range(self.words()):
@@ -0,0 +1,145 @@
+'''
+Assembler for the firmware pin sequence VM (firmware/pinvm.h)
+
+Build a program once, upload it with Bitbang.pinvm_load() and run it with
+Bitbang.pinvm_run(). Pins are 0 indexed ZIF pins like the rest of the python
+API and are converted to the firmware's 1 indexed numbering here.
+'''
+
+import struct
+
+OP_END = 0x00
+OP_ZW = 0x01
+OP_ZT = 0x02
+OP_ZR = 0x03
+OP_DLY = 0x04
+OP_LOOP = 0x05
+OP_NEXT = 0x06
+OP_BUS = 0x07
+OP_BW = 0x08
+OP_AINC = 0x09
+OP_BR = 0x0A
+OP_ASET = 0x0B
+OP_PW = 0x0C
+OP_FLUSH = 0x0D
+
+PROG_MAX = 256
+BUSES = 2
+BUS_MAX = 16
+# Program bytes per upload command
+CHUNK_MAX = 28
+
+
+class Program:
+    def __init__(self):
+        self.buf = bytearray()
+        self.bus_lens = {}
+
+    def _zif(self, val):
+        assert 0 <= val <= 0xFFFFFFFFFF
+        return struct.pack('<Q', val)[0:5]
+
+    def _pin(self, pin):
+        assert 0 <= pin <= 39
+        return pin + 1
+
+    def end(self):
+        self.buf += bytes([OP_END])
+        return self
+
+    def io_w(self, val):
+        '''Write all ZIF pins'''
+        self.buf += bytes([OP_ZW]) + self._zif(val)
+        return self
+
+    def io_tri(self, val=0xFFFFFFFFFF):
+        '''Set ZIF tristate, bit set => tristate'''
+        self.buf += bytes([OP_ZT]) + self._zif(val)
+        return self
+
+    def io_r(self):
+        '''Read all ZIF pins, 5 bytes of output'''
+        self.buf += bytes([OP_ZR])
+        return self
+
+    def delay_us(self, us):
+        assert 0 <= us <= 0xFFFF
+        self.buf += struct.pack('<BH', OP_DLY, us)
+        return self
+
+    def loop(self, count):
+        '''Repeat until next() count times, 1 to 65536'''
+        assert 1 <= count <= 0x10000
+        self.buf += struct.pack('<BH', OP_LOOP, count & 0xFFFF)
+        return self
+
+    def next(self):
+        self.buf += bytes([OP_NEXT])
+        return self
+
+    def bus(self, busid, pins):
+        '''Define bus busid from ZIF pins, LSB first'''
+        assert 0 <= busid < BUSES
+        assert 1 <= len(pins) <= BUS_MAX
+        self.buf += bytes([OP_BUS, busid, len(pins)])
+        self.buf += bytes([self._pin(pin) for pin in pins])
+        self.bus_lens[busid] = len(pins)
+        return self
+
+    def bus_w(self, busid):
+        '''Write the address register to a bus'''
+        self.buf += bytes([OP_BW, busid])
+        return self
+
+    def addr_inc(self, busid):
+        '''Increment the address register, updating a bus already written'''
+        self.buf += bytes([OP_AINC, busid])
+        return self
+
+    def bus_r(self, busid):
+        '''Read a bus, 1 byte of output (2 if wider than 8 pins)'''
+        self.buf += bytes([OP_BR, busid])
+        return self
+
+    def addr_set(self, addr):
+        assert 0 <= addr <= 0xFFFF
+        self.buf += struct.pack('<BH', OP_ASET, addr)
+        return self
+
+    def pin_w(self, pin, val):
+        self.buf += bytes([OP_PW, self._pin(pin), int(bool(val))])
+        return self
+
+    def flush(self):
+        self.buf += bytes([OP_FLUSH])
+        return self
+
+    def assemble(self):
+        if not self.buf or self.buf[-1] != OP_END:
+            self.end()
+        if len(self.buf) > PROG_MAX:
+            raise ValueError("Program too large: %u bytes" % len(self.buf))
+        return bytes(self.buf)
+
+
+def read_sweep(addr_pins, data_pins, words, start=0):
+    '''
+    Read `words` words from a parallel memory
+    addr_pins / data_pins are 0 indexed ZIF pins, LSB first
+    The address register is u16: at most BUS_MAX pins per bus
+    '''
+    if len(addr_pins) > BUS_MAX or len(data_pins) > BUS_MAX:
+        raise ValueError("Bus too wide for the pin VM")
+    p = Program()
+    p.bus(0, addr_pins)
+    p.bus(1, data_pins)
+    p.addr_set(start)
+    p.bus_w(0)
+    while words:
+        this = min(words, 0x10000)
+        p.loop(this)
+        p.bus_r(1)
+        p.addr_inc(0)
+        p.next()
+        words -= this
+    return p.assemble()
@@ -0,0 +1,93 @@
+'''
+Progress notifications from the CDC notification endpoint (EP1 IN)
+
+Long running commands (blank check, reads) post a record here every 50 ms
+and once more when they finish, so a UI can show progress without touching
+the serial data stream. See "Progress notifications" in firmware/comlib.h.
+
+On Linux cdc_acm polls EP1 itself and drops notifications it doesn't know,
+so reading them with pyusb needs the communication interface (0) detached
+from the kernel driver. That unbinds cdc_acm and takes the tty with it:
+while a Monitor is open, talk to the device over the bulk interface (EP3,
+see bulk.py), not the serial port. close() gives the tty back.
+
+Ops that post progress: at89 read ('r') and blank check ('B'), as text
+commands or frames, and the at89 write stream ('W'). Over EP3:
+
+    link = bulk.Bulk()
+    mon = Monitor()
+    link.frame('B', timeout=30.0)   # meanwhile mon.poll() in another thread
+'''
+
+import collections
+import struct
+import usb.core
+import usb.util
+
+from otl866.bootloader.driver import O_USB_VENDOR, O_USB_PRODUCT
+
+NOTIFY_INTERFACE = 0
+NOTIFY_EP_IN = 0x81
+NOTIFY_PROGRESS = 0xF0
+RECORD_LEN = 16
+
+STATE_IDLE = 0
+STATE_RUNNING = 1
+STATE_DONE = 2
+
+Progress = collections.namedtuple('Progress',
+                                  'op state addr total errors')
+
+
+def decode(buf):
+    '''Decode a notification, None if it isn't a progress record'''
+    buf = bytes(buf)
+    if len(buf) != RECORD_LEN or buf[0] != 0xA1 or buf[1] != NOTIFY_PROGRESS:
+        return None
+    op, state, addr, total, errors = struct.unpack('<BBHHH', buf[8:16])
+    return Progress(chr(op), state, addr, total, errors)
+
+
+class Monitor:
+    '''Progress reader, use with bulk.Bulk: the tty is gone while open'''
+
+    def __init__(self, device=None):
+        if device is None:
+            device = usb.core.find(idVendor=O_USB_VENDOR,
+                                   idProduct=O_USB_PRODUCT)
+            if device is None:
+                raise Exception("Failed to find an open-tl866 device")
+        self.device = device
+        self.detached = self.device.is_kernel_driver_active(NOTIFY_INTERFACE)
+        if self.detached:
+            self.device.detach_kernel_driver(NOTIFY_INTERFACE)
+        usb.util.claim_interface(self.device, NOTIFY_INTERFACE)
+
+    def close(self):
+        usb.util.release_interface(self.device, NOTIFY_INTERFACE)
+        if self.detached:
+            self.device.attach_kernel_driver(NOTIFY_INTERFACE)
+        usb.util.dispose_resources(self.device)
+
+    def poll(self, timeout=0.1):
+        '''Next progress record, None on timeout'''
+        try:
+            buf = self.device.read(NOTIFY_EP_IN, RECORD_LEN,
+                                   int(timeout * 1000))
+        except usb.core.USBTimeoutError:
+            return None
+        return decode(buf)
+
+    def follow(self, cb=None):
+        '''Report records until an operation finishes, return the last one'''
+        while True:
+            p = self.poll(timeout=1.0)
+            if p is None:
+                continue
+            if cb:
+                cb(p)
+            else:
+                print("%s: 0x%04X / 0x%04X, %u errors" %
+                      (p.op, p.addr, p.total, p.errors))
+            if p.state == STATE_DONE:
+                return p
@@ -0,0 +1,99 @@
+'''
+Decoder for the firmware event trace ring (firmware/trace.h)
+
+Build the firmware with -DTL866_TRACE=ON, run something, then:
+
+    events = trace.capture(client)
+    trace.print_timeline(events)
+'''
+
+import binascii
+import collections
+import re
+import struct
+
+# Timer1 ticks per second (Fosc / 4)
+TICK_HZ = 12000000
+
+TRACE_WRAP = 0x01
+TRACE_LATCH = 0x10
+TRACE_ZIF_WRITE = 0x20
+TRACE_ZIF_DIR = 0x28
+
+NAMES = {
+    0x02: 'cmd',
+    0x03: 'cmd_end',
+    0x04: 'frame',
+    0x05: 'frame_end',
+    0x06: 'ep2_in',
+    0x07: 'ep3_in',
+    0x08: 'vpp_en',
+    0x09: 'vpp_dis',
+    0x0A: 'vdd_en',
+    0x0B: 'vdd_dis',
+    0x0C: 'vpp_val',
+    0x0D: 'vdd_val',
+}
+# Events whose argument is a character
+CHAR_ARGS = set([0x02, 0x04, 0x05])
+
+Event = collections.namedtuple('Event', 'ticks name arg')
+
+
+def event_name(evid):
+    if TRACE_LATCH <= evid < TRACE_LATCH + 8:
+        return 'latch%u' % (evid - TRACE_LATCH)
+    if TRACE_ZIF_WRITE <= evid < TRACE_ZIF_WRITE + 5:
+        return 'zif_write[%u]' % (evid - TRACE_ZIF_WRITE)
+    if TRACE_ZIF_DIR <= evid < TRACE_ZIF_DIR + 5:
+        return 'zif_dir[%u]' % (evid - TRACE_ZIF_DIR)
+    return NAMES.get(evid, '0x%02X' % evid)
+
+
+def decode(buf):
+    '''
+    Raw dump bytes => list of Event, ticks counted from the oldest event
+    Wrap markers are folded into the timestamps. A gap of 255 or more
+    timer overflows (~1.4 s) is shortened to that.
+    '''
+    events = []
+    hi = 0
+    first = None
+    for off in range(0, len(buf) - len(buf) % 4, 4):
+        ts, evid, arg = struct.unpack('<HBB', buf[off:off + 4])
+        if evid == TRACE_WRAP:
+            hi += arg
+            continue
+        ticks = (hi << 16) | ts
+        if first is None:
+            first = ticks
+        if evid in CHAR_ARGS and arg:
+            arg = chr(arg)
+        events.append(Event(ticks - first, event_name(evid), arg))
+    return events
+
+
+def parse(text):
+    '''"TRACE n XX XX ..." line from the 'Y' command => raw bytes'''
+    m = re.search(r"TRACE (\d+)((?: [0-9A-F]{2})*)", text)
+    if not m:
+        raise ValueError("No trace dump found")
+    buf = binascii.unhexlify(m.group(2).replace(" ", ""))
+    if len(buf) != 4 * int(m.group(1)):
+        raise ValueError("Trace dump truncated")
+    return buf
+
+
+def capture(client):
+    '''Dump (and clear) the device's trace ring'''
+    return decode(parse(client.cmd('Y')))
+
+
+def print_timeline(events):
+    last = 0
+    for ev in events:
+        arg = ev.arg if isinstance(ev.arg, str) else '0x%02X' % ev.arg
+        print("%12.6f ms  +%9.3f us  %-14s %s" %
+              (ev.ticks * 1e3 / TICK_HZ, (ev.ticks - last) * 1e6 / TICK_HZ,
+               ev.name, arg))
+        last = ev.ticks
@@ -0,0 +1,114 @@
+'''
+USB link benchmark against the firmware's built in self-test frames
+
+Measures the link alone, no target involved, so a slow dump can be blamed
+on the right side. Works in any mode, over the serial console (AClient) or
+the vendor bulk interface (Bulk).
+
+    otl866 bench --bulk --bytes 1000000
+'''
+
+import struct
+import time
+
+from otl866 import aclient
+
+OP_PING = '!'
+OP_SOURCE = '}'
+OP_SINK = '{'
+# Largest SOURCE / SINK in one frame (firmware COM_TEST_MAX)
+TEST_MAX = 0xFFFE
+
+
+def pattern(n, seed=0):
+    '''Same bytes SOURCE generates: seed, seed + 1, ...'''
+    return bytes((seed + i) & 0xFF for i in range(n))
+
+
+def source(link, total, verify=True):
+    '''Device => host. Returns bytes per second'''
+    done = 0
+    tstart = time.time()
+    while done < total:
+        n = min(TEST_MAX, total - done)
+        seed = done & 0xFF
+        data = link.frame(OP_SOURCE,
+                          struct.pack('<HB', n, seed),
+                          timeout=2.0 + n / 100000)
+        if verify and data != pattern(n, seed):
+            raise aclient.BadCommand("SOURCE: data mismatch")
+        done += n
+    return total / (time.time() - tstart)
+
+
+def sink(link, total):
+    '''Host => device through credit flow control. Returns bytes per second'''
+    done = 0
+    tstart = time.time()
+    while done < total:
+        n = min(TEST_MAX, total - done)
+        # Incrementing bytes so RLE can't shrink them
+        link.frame_stream(OP_SINK, struct.pack('<H', n), pattern(n),
+                          timeout=2.0 + n / 100000)
+        done += n
+    return total / (time.time() - tstart)
+
+
+def ping(link, count, size=0):
+    '''Round trip times in seconds, one ping in flight at a time'''
+    payload = pattern(size)
+    rtts = []
+    for _ in range(count):
+        tstart = time.time()
+        if link.frame(OP_PING, payload) != payload:
+            raise aclient.BadCommand("PING: echo mismatch")
+        rtts.append(time.time() - tstart)
+    return rtts
+
+
+def percentile(samples, p):
+    '''Nearest rank percentile, p in 0 to 100'''
+    samples = sorted(samples)
+    rank = max(1, int(round(p / 100.0 * len(samples))))
+    return samples[rank - 1]
+
+
+def run(link, nbytes=1000000, pings=1000, ping_size=0):
+    print("source: %0.3f MB/s" % (source(link, nbytes) / 1e6))
+    print("sink:   %0.3f MB/s" % (sink(link, nbytes) / 1e6))
+    rtts = ping(link, pings, ping_size)
+    print("ping (%u bytes, n=%u): %s" %
+          (ping_size, pings, ", ".join("p%u %0.3f ms" %
+                                       (p, percentile(rtts, p) * 1e3)
+                                       for p in (50, 90, 99, 100))))
+
+
+def cmd_bench(args):
+    if args.bulk:
+        from otl866 import bulk
+        link = bulk.Bulk()
+    else:
+        link = aclient.AClient(args.port)
+    link.frame_session(rle=args.rle)
+    try:
+        run(link, args.bytes, args.pings, args.ping_size)
+    finally:
+        link.close()
+
+
+def build_argparse(parent):
+    parser = parent.add_parser(
+        'bench',
+        description="Measure USB throughput and latency (any mode)",
+    )
+    parser.add_argument('--port', help="Serial port (default: guess)")
+    parser.add_argument('--bulk',
+                        action='store_true',
+                        help="Use the vendor bulk interface")
+    parser.add_argument('--rle',
+                        action='store_true',
+                        help="Negotiate frame RLE (test data has no runs)")
+    parser.add_argument('--bytes', type=int, default=1000000)
+    parser.add_argument('--pings', type=int, default=1000)
+    parser.add_argument('--ping-size', type=int, default=0)
+    parser.set_defaults(func=cmd_bench)